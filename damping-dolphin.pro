@@ -56,12 +56,19 @@ HEADERS += \
     src/DampingCurve.h \
     src/DampingMode.h \
     src/MainWindow.h \
+    src/Scheme/BoundedLeastSquares.hpp \
+    src/Scheme/LevenbergMarquardt.hpp \
     src/Scheme/OptimizerTuning.hpp \
     src/Scheme/ObjectiveFunction.h \
+    src/Scheme/PopulationOptimizer.hpp \
+    src/Scheme/parallel_for.hpp \
+    src/Scheme/ShiftConvolution.hpp \
+    src/Scheme/simd.hpp \
     src/Scheme/ThreeWiseMen.h \
     src/Scheme/Unicorn.h \
     src/Scheme/TwoCities.h \
-    src/Scheme/ZeroDay.h
+    src/Scheme/ZeroDay.h \
+    src/Scheme/VariableProjection.hpp
 
 FORMS += \
     form/About.ui \
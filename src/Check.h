@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+// shared helpers of the behaviour checks run by ctest
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <armadillo>
+#include <iostream>
+
+inline int failures = 0;
+
+inline void check(const std::string& name, const double error, const double tolerance) {
+    const auto passed = std::isfinite(error) && error <= tolerance;
+    std::cout << (passed ? "pass  " : "FAIL  ") << name << ", error " << error << " tolerance " << tolerance << '\n';
+    if(!passed) ++failures;
+}
+
+// maximum difference relative to the largest magnitude of the reference
+inline double relative(const arma::vec& value, const arma::vec& reference) { return arma::abs(value - reference).max() / std::max(1E-300, arma::abs(reference).max()); }
+
+// prints the summary and returns the number of failed checks as the exit code
+inline int report() {
+    std::cout << failures << " check(s) failed.\n";
+    return failures;
+}
+
+#endif // CHECK_H
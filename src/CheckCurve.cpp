@@ -0,0 +1,158 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+// behaviour checks of the damping curve against the plain per-mode computations
+// returns the number of failed checks, run by ctest
+
+#include "Check.h"
+#include "DampingCurve.h"
+#include "DampingMode.h"
+#include "Scheme/ShiftConvolution.hpp"
+#include "qcustomplot.h"
+
+namespace {
+    std::unique_ptr<DampingMode> make_mode(const MT type, const double omega, const double zeta, const std::vector<double>& p) {
+        auto copy = p;
+        switch(type) {
+        case MT::T0:
+            return std::make_unique<DampingModeT0>(omega, zeta, std::move(copy));
+        case MT::T1:
+            return std::make_unique<DampingModeT1>(omega, zeta, std::move(copy));
+        case MT::T2:
+            return std::make_unique<DampingModeT2>(omega, zeta, std::move(copy));
+        case MT::T3:
+            return std::make_unique<DampingModeT3>(omega, zeta, std::move(copy));
+        default:
+            return std::make_unique<DampingModeT4>(omega, zeta, std::move(copy));
+        }
+    }
+
+    void check_mode_kernels() {
+        const vec x = join_cols(-reverse(logspace(-3, 5, 1001)), logspace(-3, 5, 1001));
+
+        const std::vector<std::pair<MT, std::vector<double>>> modes{
+            {MT::T0, {}},
+            {MT::T1, {0.}},
+            {MT::T1, {3.}},
+            {MT::T2, {0., 0.}},
+            {MT::T2, {2., 5.}},
+            {MT::T3, {.4}},
+            {MT::T4, {1., 2., 1., 1., .5}},
+            {MT::T4, {3., 0., 2., 1., .2}},
+        };
+
+        for(const auto& [type, p] : modes) {
+            const auto mode = make_mode(type, 7.3, .05, p);
+
+            vec batched(x.n_elem), scalar(x.n_elem);
+            mode->evaluate(x.memptr(), batched.memptr(), x.n_elem);
+            for(auto I = 0llu; I < x.n_elem; ++I) scalar(I) = (*mode)(x(I));
+
+            check("batched " + mode->str().toStdString() + " vs scalar", relative(batched, scalar), 1E-10);
+        }
+
+        // the scalar operators overflow for high orders, the batched ones have to decay to zero instead
+        for(const auto& p : {std::vector<double>{40., 40.}, std::vector<double>{60., 20., 1., 1., .5}}) {
+            const auto mode = make_mode(p.size() == 2 ? MT::T2 : MT::T4, 7.3, .05, p);
+
+            vec batched(x.n_elem);
+            mode->evaluate(x.memptr(), batched.memptr(), x.n_elem);
+
+            const uvec far = find(abs(x) < 7.3E-2 || abs(x) > 7.3E2);
+            check("batched " + mode->str().toStdString() + " far from the peak", batched.is_finite() ? abs(batched(far)).max() : datum::inf, 1E-12);
+        }
+    }
+
+    // all modes share one shape so that the total on a logarithmic grid is obtained by convolution
+    void check_convolution() {
+        DampingCurve curve;
+        for(auto J = 0u; J < 2 * dd::convolution_threshold; ++J) curve.addMode(make_mode(MT::T2, std::pow(10., -1. + 4. * randu()), .01 * randu(), {1., 2.}));
+
+        curve.updateLogarithmicDampingCurve(1E-2, 1E4, 4000);
+
+        const auto total = curve.getDampingRatioVector();
+        vec convolved(total.size()), direct(total.size(), fill::zeros);
+        for(auto I = 0; I < total.size(); ++I) convolved(I) = total[I];
+        for(auto J = 0; J < curve.count(); ++J) {
+            const auto single = curve.getDampingRatioVector(J);
+            for(auto I = 0; I < single.size(); ++I) direct(I) += single[I];
+        }
+
+        check("convolution vs direct sum", relative(convolved, direct), 1E-6);
+    }
+
+    void check_incremental() {
+        const auto add = [](DampingCurve& curve, const int J) {
+            const auto type = static_cast<MT>(J % 5);
+            const std::vector<std::vector<double>> p{{}, {2.}, {2., 3.}, {.4}, {2., 3., 1., 1., .5}};
+            curve.addMode(make_mode(type, std::pow(10., -1. + 4. * std::sin(J) * std::sin(J)), .02 * std::cos(J), p[J % 5]));
+        };
+
+        // the same edits applied to a computed curve and before the first computation
+        DampingCurve incremental, full;
+        for(auto J = 0; J < 60; ++J) {
+            add(incremental, J);
+            add(full, J);
+        }
+        incremental.updateLinearDampingCurve(0., 1E3, 3000);
+        for(const auto J : {5, 17, 0, 40}) {
+            incremental.removeMode(J);
+            full.removeMode(J);
+        }
+        incremental.addModes(MT::T1, Mat<double>{{3., .01, 1.}, {30., -.005, 4.}});
+        full.addModes(MT::T1, Mat<double>{{3., .01, 1.}, {30., -.005, 4.}});
+        full.updateLinearDampingCurve(0., 1E3, 3000);
+
+        const auto a = incremental.getDampingRatioVector(), b = full.getDampingRatioVector();
+        check("incremental vs full recompute", relative(conv_to<vec>::from(std::vector<double>(a.begin(), a.end())), conv_to<vec>::from(std::vector<double>(b.begin(), b.end()))), 1E-12);
+        check("incremental vs full extrema", std::max(std::abs(incremental.minDampingRatio() - full.minDampingRatio()), std::abs(incremental.maxDampingRatio() - full.maxDampingRatio())), 1E-12);
+    }
+
+    // the plotted points follow the curve whether the container is resized or overwritten in place
+    void check_graph_data() {
+        DampingCurve curve;
+        curve.addModes(MT::T2, Mat<double>{{3., .01, 1., 2.}, {30., -.005, 2., 1.}});
+
+        QCPGraphDataContainer data;
+        auto error = 0.;
+        for(const auto samples : {3000, 1000, 1000}) {
+            curve.updateLogarithmicDampingCurve(1E-1, 1E3, samples);
+            curve.fillGraphData(data);
+
+            const auto& omega = curve.getFrequencyVector();
+            const auto zeta = curve.getDampingRatioVector();
+            if(data.size() != omega.size()) error = datum::inf;
+            else {
+                auto I = data.begin();
+                for(auto i = 0; i < omega.size(); ++i, ++I) error = std::max({error, std::abs(I->key - omega[i]), std::abs(I->value - zeta[i])});
+            }
+        }
+
+        check("graph data vs curve", error, 0.);
+    }
+} // namespace
+
+int main() {
+    arma_rng::set_seed(20260101);
+
+    check_mode_kernels();
+    check_convolution();
+    check_incremental();
+    check_graph_data();
+
+    return report();
+}
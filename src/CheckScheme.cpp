@@ -0,0 +1,220 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+// behaviour checks of the scheme objectives and optimizers, they only need the scheme headers
+// returns the number of failed checks, run by ctest
+
+#include "Check.h"
+#include "Scheme/Scheme"
+#include "Scheme/ShiftConvolution.hpp"
+
+namespace {
+    // ascending frequencies with a constant ratio, or jittered so that the generic kernels are used
+    Mat<double> sampling(const uword n, const bool geometric) {
+        Mat<double> s(2, n);
+        s.row(0) = logspace<rowvec>(-1, 3, n);
+        if(!geometric) s.row(0) = sort(s.row(0) % (1. + .2 * randu<rowvec>(n)));
+        s.row(1) = .02 + .01 * sin(log(s.row(0)));
+        return s;
+    }
+
+    // the vectorizable exp/log are expected to be accurate to a few ulp over the range the kernels use
+    void check_simd() {
+        const vec x = linspace(-700., 700., 100001);
+        vec value(x.n_elem), reference(x.n_elem);
+        for(auto I = 0llu; I < x.n_elem; ++I) {
+            value(I) = dd::simd::exp(x(I));
+            reference(I) = std::exp(x(I));
+        }
+        check("simd exp vs std::exp", max(abs(value - reference) / reference), 4. * datum::eps);
+
+        const vec y = logspace(-300., 300., 100001);
+        for(auto I = 0llu; I < y.n_elem; ++I) {
+            value(I) = dd::simd::log(y(I));
+            reference(I) = std::log(y(I));
+        }
+        check("simd log vs std::log", max(abs(value - reference) / clamp(abs(reference), 1., datum::inf)), 4. * datum::eps);
+    }
+
+    // the kernels used off geometric grids have to decay to zero for high orders instead of saturating
+    void check_two_cities_kernel() {
+        const vec x = logspace(-3, 5, 2001);
+        const uvec far = find(x < 7.3E-2 || x > 7.3E2);
+
+        for(const auto order : {40., 200.}) {
+            const double p[]{7.3, .05, order, order};
+            vec response(x.n_elem);
+            Mat<double> gradient(x.n_elem, 5);
+            TwoCities<double>::compute_response(x.memptr(), x.n_elem, p, response.memptr());
+            TwoCities<double>::compute_gradient(x.memptr(), x.n_elem, p, gradient.memptr(), x.n_elem);
+
+            check("TwoCities order " + std::to_string(static_cast<int>(order)) + " far from the peak", response.is_finite() && gradient.is_finite() ? abs(response(far)).max() : datum::inf, 1E-12);
+        }
+    }
+
+    template<typename S> void check_scheme(const std::string& name, const bool geometric) {
+        const auto label = name + (geometric ? " geometric" : " irregular");
+
+        S f(3);
+        f.initializeSampling(sampling(600, geometric));
+
+        const Mat<double> x = randn(f.getSize() * f.getNumberModes(), 1);
+
+        // nothing is cached yet so that both paths are evaluated
+        Mat<double> g;
+        const auto value = f.Evaluate(x);
+        check(label + " value vs value with gradient", std::abs(f.EvaluateWithGradient(x, g) - value) / value, 1E-12);
+
+        Mat<double> fd(size(x));
+        for(auto I = 0llu; I < x.n_elem; ++I) {
+            constexpr auto step = 1E-6;
+            Mat<double> a = x, b = x;
+            a(I) += step;
+            b(I) -= step;
+            fd(I) = (f.Evaluate(a) - f.Evaluate(b)) / (2. * step);
+        }
+        check(label + " gradient vs finite difference", relative(vectorise(g), vectorise(fd)), 1E-5);
+
+        // candidates are scored in one sweep, each column has to match its own evaluation
+        const Mat<double> candidates = join_rows(x, randn(size(x)), randn(size(x)));
+        Col<double> batch;
+        f.EvaluateBatch(candidates, batch);
+        vec single(candidates.n_cols);
+        for(auto I = 0llu; I < candidates.n_cols; ++I) single(I) = f.Evaluate(candidates.col(I));
+        check(label + " batch vs single evaluation", relative(batch, single), 1E-12);
+
+        Col<double> r;
+        Mat<double> jacobian;
+        f.EvaluateWithJacobian(x, r, jacobian);
+        check(label + " Jacobian vs gradient", relative(vectorise(2. * jacobian.t() * r), vectorise(g)), 1E-10);
+
+        // with locality the sparse and the dense Jacobian cover the same supports
+        f.setLocality(1E-8);
+        Col<double> rs;
+        SpMat<double> sparse;
+        f.EvaluateWithJacobian(x, r, jacobian);
+        f.EvaluateWithJacobian(x, rs, sparse);
+        check(label + " sparse vs dense Jacobian", std::max(relative(vectorise(Mat<double>(sparse)), vectorise(jacobian)), relative(rs, r)), 1E-12);
+        f.setLocality(0.);
+
+        // the projected Jacobian keeps J^T*r equal to the gradient of the projected objective
+        VariableProjection<double> p(f);
+        const Mat<double> y = randn(p.getSize() * p.getNumberModes(), 1);
+        p.EvaluateWithGradient(y, g);
+        p.EvaluateWithJacobian(y, r, jacobian);
+        check(label + " projected Jacobian vs gradient", relative(vectorise(2. * jacobian.t() * r), vectorise(g)), 1E-10);
+    }
+
+    // many modes of one shape on a geometric grid, the value must not depend on whether the gradient is requested
+    void check_many_modes() {
+        ZeroDay<double> f(2 * dd::convolution_threshold);
+        f.initializeSampling(sampling(1000, true));
+
+        const Mat<double> x = randn(f.getSize() * f.getNumberModes(), 1);
+
+        Mat<double> g;
+        const auto value = f.Evaluate(x);
+        check("many modes value vs value with gradient", std::abs(f.EvaluateWithGradient(x, g) - value) / value, 1E-13);
+    }
+
+    void check_bounded_least_squares() {
+        const Mat<double> a = randn(200, 12);
+        const vec b = randn(200);
+        const Mat<double> gram = a.t() * a;
+        const vec rhs = a.t() * b;
+
+        constexpr auto upper = .1;
+        const vec z = dd::bounded_least_squares<double>(gram, rhs, 0., upper);
+
+        // Karush-Kuhn-Tucker conditions, the gradient vanishes on free variables and points outwards on active bounds
+        const vec gradient = gram * z - rhs;
+        auto error = 0.;
+        for(auto I = 0llu; I < z.n_elem; ++I) {
+            if(z(I) < 0. || z(I) > upper) error = datum::inf;
+            else if(z(I) == 0.) error = std::max(error, -gradient(I));
+            else if(z(I) == upper) error = std::max(error, gradient(I));
+            else error = std::max(error, std::abs(gradient(I)));
+        }
+        check("bounded least squares optimality", error / abs(rhs).max(), 1E-10);
+    }
+
+    // each optimizer draws from its own generator, the same seed has to reproduce the same run
+    template<typename T> void check_population(const std::string& name) {
+        ZeroDay<double> f(2);
+        f.initializeSampling(sampling(300, true));
+
+        const Mat<double> initial = randn(f.getSize() * f.getNumberModes(), 1);
+
+        Mat<double> x = initial, y = initial;
+        T a(200), b(200);
+        a.Generator().seed(7);
+        b.Generator().seed(7);
+        a.Optimize(f, x);
+        b.Optimize(f, y);
+
+        check(name + " is reproducible with the same seed", f.Evaluate(x) < f.Evaluate(initial) ? abs(x - y).max() : datum::inf, 0.);
+    }
+
+    // asks the optimizer to stop before it takes any step
+    struct StopAtBegin {
+        template<typename OptimizerType, typename FunctionType, typename MatType> bool BeginOptimization(OptimizerType&, FunctionType&, const MatType&) { return true; }
+    };
+
+    void check_levenberg_marquardt() {
+        Unicorn<double> f(4);
+        f.initializeSampling(sampling(400, true));
+
+        Mat<double> x = randn(f.getSize() * f.getNumberModes(), 1), g;
+        const auto initial = f.EvaluateWithGradient(x, g);
+        const auto initial_gradient = norm(g);
+
+        LevenbergMarquardt optimizer;
+        optimizer.Tolerance() = 1E-12;
+        optimizer.Optimize(f, x);
+
+        // a stationary point with a lower objective
+        const auto final = f.EvaluateWithGradient(x, g);
+        check("Levenberg-Marquardt reaches a stationary point", final < initial ? norm(g) / initial_gradient : datum::inf, 1E-6);
+
+        const Mat<double> start = randn(size(x));
+        x = start;
+        optimizer.Optimize(f, x, StopAtBegin());
+        check("Levenberg-Marquardt stops when asked at the beginning", abs(x - start).max(), 0.);
+    }
+} // namespace
+
+int main() {
+    arma_rng::set_seed(20260101);
+
+    check_simd();
+    check_two_cities_kernel();
+
+    for(const auto geometric : {true, false}) {
+        check_scheme<ZeroDay<double>>("ZeroDay", geometric);
+        check_scheme<Unicorn<double>>("Unicorn", geometric);
+        check_scheme<TwoCities<double>>("TwoCities", geometric);
+        check_scheme<ThreeWiseMen<double>>("ThreeWiseMen", geometric);
+    }
+
+    check_many_modes();
+    check_bounded_least_squares();
+    check_population<BatchCMAES>("CMA-ES");
+    check_population<BatchPSO>("PSO");
+    check_levenberg_marquardt();
+
+    return report();
+}
@@ -16,75 +16,400 @@
  ******************************************************************************/
 
 #include "DampingCurve.h"
-#include "DampingMode.h"
+#include "Scheme/ShiftConvolution.hpp"
+#include "Scheme/parallel_for.hpp"
+#include "qcustomplot.h"
+
+#include <map>
+
+namespace {
+    // samples are processed in blocks of this size so that a task covers enough work and stays in cache
+    constexpr uword block_size = 256;
+
+    uword block_count(const uword samples) { return (samples + block_size - 1) / block_size; }
+
+    // calls action(begin, end) on consecutive blocks of samples in parallel
+    template<typename F> void for_each_block(const uword samples, F&& action) {
+        dd::parallel_for(0llu, block_count(samples), [&](const uword block) { action(block * block_size, std::min(block * block_size + block_size, samples)); });
+    }
+
+    // adaptive sampling refines intervals where the curve deviates from a straight line by more than this fraction of its range
+    constexpr auto bend_tolerance = 1E-3;
+    // each level of refinement halves the spacing
+    constexpr auto refinement_depth = 6;
+    // refinement stops once there are this many samples per pixel
+    constexpr size_t refinement_budget = 8;
+} // namespace
+
+bool DampingCurve::initializeVector(const double start, const double end, const size_t samples, const bool geometric) {
+    if(!stale && !grid_adaptive && start == grid_start && end == grid_end && samples == grid_samples && geometric == grid_geometric) return false;
+
+    grid_start = start;
+    grid_end = end;
+    grid_samples = samples;
+    grid_geometric = geometric;
+    grid_adaptive = false;
+    stale = false;
+    removals = 0;
 
-void DampingCurve::initializeVector(const size_t samples) {
     const auto size = static_cast<int>(samples);
     omega.resize(size);
     zeta_sum.resize(size);
-    zeta.resize(damping_modes.size());
-    for(auto& I : zeta)
-        I.resize(size);
+    zeta.assign(damping_modes.size(), vec());
+    zeta_range.assign(damping_modes.size(), {0., 0.});
+
+    return true;
+}
+
+bool DampingCurve::evaluated(const int tag) const {
+    return zeta[tag].n_elem == static_cast<uword>(omega.size());
 }
 
-void DampingCurve::computeCurve() {
-    for(auto j = 0; j < damping_modes.size(); ++j)
-        for(auto i = 0; i < omega.size(); ++i) {
-            zeta[j][i] = damping_modes[j]->operator()(omega[i]);
-            zeta_sum[i] += zeta[j][i];
+void DampingCurve::computeMode(const int tag) {
+    auto& curve = zeta[tag];
+    curve.set_size(omega.size());
+    damping_modes.evaluate(tag, omega.data(), curve.memptr(), omega.size());
+
+    if(curve.is_empty()) return;
+    zeta_range[tag] = {std::min(0., curve.min()), std::max(0., curve.max())};
+}
+
+void DampingCurve::accumulate(const int tag, const double factor) {
+    auto* total = zeta_sum.data();
+    const auto* curve = zeta[tag].memptr();
+
+    auto low = 0., high = 0.;
+#ifdef _OPENMP
+#pragma omp simd reduction(min : low) reduction(max : high)
+#endif
+    for(auto i = 0; i < zeta_sum.size(); ++i) {
+        total[i] += factor * curve[i];
+        low = std::min(low, total[i]);
+        high = std::max(high, total[i]);
+    }
+
+    sum_range = {low, high};
+}
+
+void DampingCurve::computeCurve(const std::stop_token stop) {
+    std::fill(zeta_sum.begin(), zeta_sum.end(), 0.);
+
+    // curves of single modes are computed on request, the total of large groups of modes
+    // sharing one shape on a logarithmic grid is obtained by convolution
+    QVector<bool> convolved(damping_modes.size(), false);
+    if(grid_geometric && !grid_adaptive && omega.size() > 2 && damping_modes.size() >= static_cast<int>(dd::convolution_threshold)) {
+        std::map<std::pair<MT, std::vector<double>>, QVector<int>> shapes;
+        for(auto j = 0; j < damping_modes.size(); ++j)
+            if(damping_modes.frequency(j) > 0.) shapes[damping_modes.shape(j)].push_back(j);
+
+        for(const auto& [key, members] : shapes) {
+            if(stop.stop_requested()) break;
+
+            // the first mode with a nonzero amplitude provides the shape, silent modes before it are left to the direct sum
+            const auto first = std::find_if(members.cbegin(), members.cend(), [&](const int k) { return damping_modes.amplitude(k) != 0.; });
+            if(members.cend() - first < static_cast<qsizetype>(dd::convolution_threshold)) continue;
+
+            const QVector<int> group(first, members.cend());
+            const auto j = group.front();
+
+            vec log_w(group.size()), z(group.size());
+            for(auto k = 0; k < group.size(); ++k) {
+                log_w(k) = log(damping_modes.frequency(group[k]));
+                z(k) = damping_modes.amplitude(group[k]);
+                convolved[group[k]] = true;
+            }
+
+            const auto step = log(omega.back() / omega.front()) / static_cast<double>(omega.size() - 1);
+            const auto sampled = [&](const double u0, const uword n, double* values) {
+                const vec sample = damping_modes.frequency(j) * exp(u0 + step * regspace(0, n - 1));
+                damping_modes.evaluate(j, sample.memptr(), values, static_cast<qsizetype>(n));
+                for(auto i = 0llu; i < n; ++i) values[i] /= damping_modes.amplitude(j);
+            };
+
+            dd::shift_sum(log(omega.front()), step, omega.size(), log_w, z, sampled, zeta_sum.data());
         }
+    }
+
+    // modes are visited type by type in the order their records are stored
+    QVector<int> direct;
+    for(const auto j : damping_modes.grouped())
+        if(!convolved[j]) direct.push_back(j);
+
+    const auto samples = static_cast<uword>(omega.size());
+    const auto* grid = omega.data();
+    auto* total = zeta_sum.data();
+
+    for(const auto tag : std::as_const(direct)) zeta[tag].set_size(samples);
+
+    using range_list = std::vector<std::pair<double, double>>;
+
+    // every block of samples is evaluated and summed while it is still in cache
+    // modes are added in a fixed order so that the total does not depend on scheduling
+    // the extrema of each mode and of the total are collected in the same pass, the last entry holds the total
+    const auto extrema = dd::parallel_reduce(
+        0llu, block_count(samples), range_list(direct.size() + 1, {0., 0.}), [&](const uword block, range_list& range) {
+            if(stop.stop_requested()) return;
+            const auto begin = block * block_size, end = std::min(begin + block_size, samples);
+            for(auto k = 0; k < direct.size(); ++k) {
+                const auto tag = direct.at(k);
+                auto* curve = zeta[tag].memptr();
+                damping_modes.evaluate(tag, grid + begin, curve + begin, static_cast<qsizetype>(end - begin));
+                auto low = range[k].first, high = range[k].second;
+#ifdef _OPENMP
+#pragma omp simd reduction(min : low) reduction(max : high)
+#endif
+                for(auto i = begin; i < end; ++i) {
+                    low = std::min(low, curve[i]);
+                    high = std::max(high, curve[i]);
+                    total[i] += curve[i];
+                }
+                range[k] = {low, high};
+            }
+            auto low = range.back().first, high = range.back().second;
+            for(auto i = begin; i < end; ++i) {
+                low = std::min(low, total[i]);
+                high = std::max(high, total[i]);
+            }
+            range.back() = {low, high};
+        },
+        [](range_list a, const range_list& b) {
+            for(auto k = 0llu; k < a.size(); ++k) a[k] = {std::min(a[k].first, b[k].first), std::max(a[k].second, b[k].second)};
+            return a;
+        });
+
+    if(stop.stop_requested()) {
+        stale = true;
+        return;
+    }
+
+    for(auto k = 0; k < direct.size(); ++k) zeta_range[direct.at(k)] = extrema[k];
+    sum_range = extrema.back();
+    removals = 0;
 }
 
 void DampingCurve::addMode(std::unique_ptr<DampingMode>&& new_mode) {
-    damping_modes.push_back(std::forward<std::unique_ptr<DampingMode>>(new_mode));
+    damping_modes.push_back(*new_mode);
+    zeta.emplace_back();
+    zeta_range.emplace_back(0., 0.);
+
+    if(stale) return;
+
+    // only the new mode is evaluated on the current grid
+    const auto tag = static_cast<int>(damping_modes.size() - 1);
+    computeMode(tag);
+    accumulate(tag, 1.);
+}
+
+void DampingCurve::addModes(const MT type, const mat& parameters) {
+    const auto first = damping_modes.size();
+    damping_modes.append(type, parameters);
+    zeta.resize(damping_modes.size());
+    zeta_range.resize(damping_modes.size(), {0., 0.});
+
+    if(stale) return;
+
+    // new modes are evaluated independently and then added in the order of their tags
+    dd::parallel_for(first, damping_modes.size(), [&](const int tag) { computeMode(tag); });
+    for(auto tag = first; tag < damping_modes.size(); ++tag) accumulate(tag, 1.);
 }
 
 void DampingCurve::removeMode(const int tag) {
     if(-1 == tag) {
         damping_modes.clear();
+        zeta.clear();
+        zeta_range.clear();
+        std::fill(zeta_sum.begin(), zeta_sum.end(), 0.);
+        sum_range = {0., 0.};
+        removals = 0;
         return;
     }
 
     if(tag < damping_modes.size()) {
-        damping_modes.erase(damping_modes.begin() + tag);
+        // the curve is subtracted from the total, which is summed again from scratch once in a while to limit drift
+        if(!stale) {
+            if(!evaluated(tag)) computeMode(tag);
+            accumulate(tag, -1.);
+        }
+
+        damping_modes.erase(tag);
+        zeta.erase(zeta.begin() + tag);
+        zeta_range.erase(zeta_range.begin() + tag);
+
+        if(!stale && ++removals >= resummation_interval) computeCurve();
         return;
     }
 }
 
-void DampingCurve::updateLinearDampingCurve(const double start, const double end, const size_t samples) {
-    initializeVector(samples);
+void DampingCurve::updateLinearDampingCurve(const double start, const double end, const size_t samples, const std::stop_token stop) {
+    if(!initializeVector(start, end, samples, false)) return;
 
     const auto gap = end - start;
 
-    for(int i = 0; i < static_cast<int>(samples); ++i) {
-        omega[i] = static_cast<double>(i) / (static_cast<double>(samples) - 1.) * gap + start;
-        zeta_sum[i] = 0.;
-    }
+    auto* grid = omega.data();
+    for_each_block(samples, [&](const uword begin, const uword end) {
+        for(auto i = begin; i < end; ++i) grid[i] = static_cast<double>(i) / (static_cast<double>(samples) - 1.) * gap + start;
+    });
 
-    computeCurve();
+    computeCurve(stop);
 }
 
-void DampingCurve::updateLogarithmicDampingCurve(double start, double end, const size_t samples) {
-    initializeVector(samples);
+void DampingCurve::updateLogarithmicDampingCurve(double start, double end, const size_t samples, const std::stop_token stop) {
+    if(!initializeVector(start, end, samples, true)) return;
 
     start = log10(start);
     end = log10(end);
 
     const auto gap = end - start;
 
-    for(int i = 0; i < static_cast<int>(samples); ++i) {
-        omega[i] = pow(10., static_cast<double>(i) / (static_cast<double>(samples) - 1.) * gap + start);
-        zeta_sum[i] = 0.;
+    auto* grid = omega.data();
+    for_each_block(samples, [&](const uword begin, const uword end) {
+        for(auto i = begin; i < end; ++i) grid[i] = pow(10., static_cast<double>(i) / (static_cast<double>(samples) - 1.) * gap + start);
+    });
+
+    computeCurve(stop);
+}
+
+void DampingCurve::updateAdaptiveDampingCurve(const double start, const double end, const size_t pixels, const bool geometric, const std::stop_token stop) {
+    if(!stale && grid_adaptive && start == grid_start && end == grid_end && pixels == grid_samples && geometric == grid_geometric) return;
+
+    if(!(end > start) || (geometric && start <= 0.)) return;
+
+    // samples are placed by their position on the axis, which is the exponent on a logarithmic axis
+    // positions lie on a lattice anchored at zero with a power-of-two spacing of about one pixel
+    // so that they are exact and coincide between viewports as well as between levels of refinement
+    const auto lower = geometric ? log10(start) : start, upper = geometric ? log10(end) : end;
+    const auto spacing = exp2(floor(log2((upper - lower) / static_cast<double>(std::max(pixels, size_t{1})))));
+    const auto frequency = [&](const double position) { return geometric ? pow(10., position) : position; };
+
+    const auto modes = damping_modes.size();
+
+    // the source of each sample, a non-negative index into the current grid or -1-k for the k-th fresh sample
+    std::map<double, sword> layout;
+    std::vector<double> fresh, fresh_total;
+    std::vector<std::vector<double>> fresh_zeta(modes);
+
+    const auto reuse = !stale && !omega.isEmpty();
+
+    const auto locate = [&](const std::vector<double>& candidate) {
+        std::vector<double> batch;
+        for(const auto position : candidate) {
+            if(layout.contains(position)) continue;
+            const auto w = frequency(position);
+            if(reuse)
+                if(const auto I = std::lower_bound(omega.cbegin(), omega.cend(), w); I != omega.cend() && *I == w) {
+                    layout.emplace(position, static_cast<sword>(I - omega.cbegin()));
+                    continue;
+                }
+            layout.emplace(position, -1 - static_cast<sword>(fresh.size() + batch.size()));
+            batch.push_back(w);
+        }
+
+        if(batch.empty()) return;
+
+        const auto offset = fresh.size();
+        fresh.insert(fresh.end(), batch.cbegin(), batch.cend());
+        fresh_total.resize(fresh.size(), 0.);
+
+        dd::parallel_for(0, static_cast<int>(modes), [&](const int tag) {
+            fresh_zeta[tag].resize(fresh.size());
+            damping_modes.evaluate(tag, batch.data(), fresh_zeta[tag].data() + offset, static_cast<qsizetype>(batch.size()));
+        });
+
+        for(const auto& I : fresh_zeta)
+            for(auto k = offset; k < fresh.size(); ++k) fresh_total[k] += I[k];
+    };
+
+    const auto total = [&](const sword source) { return source >= 0 ? zeta_sum[source] : fresh_total[-1 - source]; };
+
+    std::vector<double> candidate;
+    const auto first = static_cast<sword>(floor(lower / spacing)), last = static_cast<sword>(ceil(upper / spacing));
+    for(auto i = first; i <= last; ++i) candidate.push_back(static_cast<double>(i) * spacing);
+    locate(candidate);
+
+    for(auto level = 0; level < refinement_depth && layout.size() < refinement_budget * pixels && !stop.stop_requested(); ++level) {
+        auto low = 0., high = 0.;
+        for(const auto& I : layout) {
+            low = std::min(low, total(I.second));
+            high = std::max(high, total(I.second));
+        }
+
+        // both neighbouring intervals of a sample off the chord through its neighbours are halved
+        candidate.clear();
+        for(auto I = std::next(layout.cbegin()); I != layout.cend() && std::next(I) != layout.cend(); ++I) {
+            const auto& [a, za] = *std::prev(I);
+            const auto& [b, zb] = *I;
+            const auto& [c, zc] = *std::next(I);
+            if(std::abs(total(zb) - (total(za) * (c - b) + total(zc) * (b - a)) / (c - a)) <= bend_tolerance * (high - low)) continue;
+            candidate.push_back(.5 * (a + b));
+            candidate.push_back(.5 * (b + c));
+        }
+
+        if(candidate.empty()) break;
+
+        locate(candidate);
     }
 
-    computeCurve();
+    // the current curve is left untouched
+    if(stop.stop_requested()) return;
+
+    const auto samples = static_cast<int>(layout.size());
+
+    QVector<double> new_omega, new_sum;
+    new_omega.reserve(samples);
+    new_sum.reserve(samples);
+    std::vector<sword> source;
+    source.reserve(samples);
+    for(const auto& [position, origin] : layout) {
+        new_omega.push_back(frequency(position));
+        new_sum.push_back(total(origin));
+        source.push_back(origin);
+    }
+
+    // modes whose curve is not available on the current grid remain to be computed on request
+    const auto reused = std::any_of(source.cbegin(), source.cend(), [](const sword origin) { return origin >= 0; });
+    std::vector<vec> new_zeta(modes);
+    dd::parallel_for(0, static_cast<int>(modes), [&](const int tag) {
+        if(reused && !evaluated(tag)) return;
+        auto& curve = new_zeta[tag];
+        curve.set_size(samples);
+        for(auto i = 0; i < samples; ++i) curve(i) = source[i] >= 0 ? zeta[tag](source[i]) : fresh_zeta[tag][-1 - source[i]];
+    });
+
+    omega = std::move(new_omega);
+    zeta_sum = std::move(new_sum);
+    zeta = std::move(new_zeta);
+
+    zeta_range.assign(modes, {0., 0.});
+    for(auto tag = 0; tag < static_cast<int>(modes); ++tag)
+        if(evaluated(tag) && samples > 0) zeta_range[tag] = {std::min(0., zeta[tag].min()), std::max(0., zeta[tag].max())};
+
+    sum_range = {0., 0.};
+    for(const auto I : std::as_const(zeta_sum)) sum_range = {std::min(sum_range.first, I), std::max(sum_range.second, I)};
+
+    grid_start = start;
+    grid_end = end;
+    grid_samples = pixels;
+    grid_geometric = geometric;
+    grid_adaptive = true;
+    stale = false;
+    removals = 0;
+}
+
+void DampingCurve::evaluateModes(const std::stop_token stop) {
+    if(stale) return;
+
+    dd::parallel_for(0, damping_modes.size(), [&](const int tag) {
+        if(!stop.stop_requested() && !evaluated(tag)) computeMode(tag);
+    });
 }
 
 double DampingCurve::query(const double in_omega) {
-    double out_zeta = 0.;
+    double out_zeta = 0., value;
 
-    for(const auto& I : std::as_const(damping_modes))
-        out_zeta += I->operator()(in_omega);
+    for(auto tag = 0; tag < damping_modes.size(); ++tag) {
+        damping_modes.evaluate(tag, &in_omega, &value, 1);
+        out_zeta += value;
+    }
 
     return out_zeta;
 }
@@ -93,17 +418,40 @@ const QVector<double>& DampingCurve::getFrequencyVector() {
     return omega;
 }
 
-const QVector<double>& DampingCurve::getDampingRatioVector(const int tag) {
+QVector<double> DampingCurve::getDampingRatioVector(const int tag) {
     if(-1 == tag) return zeta_sum;
 
-    return zeta[tag];
+    if(!evaluated(tag)) computeMode(tag);
+
+    return QVector<double>(zeta[tag].begin(), zeta[tag].end());
+}
+
+void DampingCurve::fillGraphData(QCPGraphDataContainer& data, const int tag) {
+    if(-1 != tag && !evaluated(tag)) computeMode(tag);
+
+    const auto* value = -1 == tag ? zeta_sum.constData() : zeta[tag].memptr();
+
+    // frequencies are ascending, so points are overwritten in place or replaced in one pass without any sorting
+    if(data.size() == omega.size()) {
+        auto I = data.begin();
+        for(auto i = 0; i < omega.size(); ++i, ++I) {
+            I->key = omega[i];
+            I->value = value[i];
+        }
+        return;
+    }
+
+    QVector<QCPGraphData> points;
+    points.reserve(omega.size());
+    for(auto i = 0; i < omega.size(); ++i) points.append(QCPGraphData(omega[i], value[i]));
+    data.set(points, true);
 }
 
 QStringList DampingCurve::getTypeInfo() {
     QStringList type_list;
 
-    for(const auto& I : std::as_const(damping_modes))
-        type_list.append(I->str());
+    for(auto tag = 0; tag < damping_modes.size(); ++tag)
+        type_list.append(damping_modes.mode(tag)->str());
 
     return type_list;
 }
@@ -111,8 +459,8 @@ QStringList DampingCurve::getTypeInfo() {
 QStringList DampingCurve::getCommand() {
     QStringList command_list;
 
-    for(const auto& I : std::as_const(damping_modes))
-        command_list.append(I->command());
+    for(auto tag = 0; tag < damping_modes.size(); ++tag)
+        command_list.append(damping_modes.mode(tag)->command());
 
     return command_list;
 }
@@ -129,31 +477,27 @@ double DampingCurve::maxFrequency() const {
     return *std::max_element(omega.cbegin(), omega.cend());
 }
 
-double DampingCurve::minDampingRatio() {
-    auto min_zeta = 0.;
-
-    for(const auto& I : std::as_const(zeta))
-        min_zeta = std::min(min_zeta, *std::min_element(I.cbegin(), I.cend()));
+double DampingCurve::minDampingRatio() const {
+    auto min_zeta = sum_range.first;
 
-    min_zeta = std::min(min_zeta, *std::min_element(zeta_sum.cbegin(), zeta_sum.cend()));
+    for(const auto& I : zeta_range) min_zeta = std::min(min_zeta, I.first);
 
     return std::max(min_zeta, -1.);
 }
 
-double DampingCurve::maxDampingRatio() {
-    auto max_zeta = 0.;
+double DampingCurve::maxDampingRatio() const {
+    auto max_zeta = sum_range.second;
 
-    for(const auto& I : std::as_const(zeta))
-        max_zeta = std::max(max_zeta, *std::max_element(I.cbegin(), I.cend()));
-
-    max_zeta = std::max(max_zeta, *std::max_element(zeta_sum.cbegin(), zeta_sum.cend()));
+    for(const auto& I : zeta_range) max_zeta = std::max(max_zeta, I.second);
 
     return std::min(max_zeta, 1.);
 }
 
 void DampingCurve::tidyUp() {
-    for(const auto& I : damping_modes)
-        I->tidyUp();
+    damping_modes.tidyUp();
+
+    // parameters may have changed
+    stale = true;
 }
 
 void ControlPoint::addPoint(const double in_omega, const double in_zeta) {
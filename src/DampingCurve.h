@@ -18,9 +18,13 @@
 #ifndef DAMPINGCURVE_H
 #define DAMPINGCURVE_H
 
-#include "damping-dolphin.h"
+#include "DampingMode.h"
 
-class DampingMode;
+#include <stop_token>
+
+class QCPGraphData;
+template<class DataType> class QCPDataContainer;
+using QCPGraphDataContainer = QCPDataContainer<QCPGraphData>;
 
 class ControlPoint {
     QVector<double> omega;
@@ -44,25 +48,47 @@ public:
 };
 
 class DampingCurve {
-    QVector<std::shared_ptr<DampingMode>> damping_modes;
-    QVector<QVector<double>> zeta;
+    ModeTable damping_modes;
+    // one curve per mode, curves are filled on request and kept across edits of other modes
+    std::vector<vec> zeta;
     QVector<double> zeta_sum;
     QVector<double> omega;
-
-    void initializeVector(size_t);
-    void computeCurve();
+    // extrema of each evaluated mode and of the total, zero is always included
+    std::vector<std::pair<double, double>> zeta_range;
+    std::pair<double, double> sum_range{0., 0.};
+
+    // the grid the curves are sampled on, curves are only recomputed from scratch when it changes
+    double grid_start{0.}, grid_end{0.};
+    size_t grid_samples{0};
+    // adaptive grids are refined where the curve bends and carry the pixel count as their sample count
+    bool grid_geometric{false}, grid_adaptive{false}, stale{true};
+    // the total is summed again from scratch after this many removals
+    static constexpr unsigned resummation_interval = 64;
+    unsigned removals{0};
+
+    bool initializeVector(double, double, size_t, bool);
+    [[nodiscard]] bool evaluated(int) const;
+    void computeMode(int);
+    void accumulate(int, double);
+    void computeCurve(std::stop_token = {});
 
 public:
     void addMode(std::unique_ptr<DampingMode>&&);
+    void addModes(MT, const mat&);
     void removeMode(int = -1);
 
-    void updateLinearDampingCurve(double, double, size_t);
-    void updateLogarithmicDampingCurve(double, double, size_t);
+    // a computation that is stopped leaves the curve to be computed again by the next update
+    void updateLinearDampingCurve(double, double, size_t, std::stop_token = {});
+    void updateLogarithmicDampingCurve(double, double, size_t, std::stop_token = {});
+    void updateAdaptiveDampingCurve(double, double, size_t, bool, std::stop_token = {});
+    // computes the curves of single modes that are otherwise computed on request
+    void evaluateModes(std::stop_token = {});
 
     double query(double);
 
     const QVector<double>& getFrequencyVector();
-    const QVector<double>& getDampingRatioVector(int = -1);
+    QVector<double> getDampingRatioVector(int = -1);
+    void fillGraphData(QCPGraphDataContainer&, int = -1);
 
     QStringList getTypeInfo();
     QStringList getCommand();
@@ -70,8 +96,8 @@ public:
 
     [[nodiscard]] double minFrequency() const;
     [[nodiscard]] double maxFrequency() const;
-    double minDampingRatio();
-    double maxDampingRatio();
+    [[nodiscard]] double minDampingRatio() const;
+    [[nodiscard]] double maxDampingRatio() const;
 
     void tidyUp();
 };
@@ -16,10 +16,111 @@
  ******************************************************************************/
 
 #include "DampingMode.h"
+#include "Scheme/simd.hpp"
+
+namespace {
+    // the batched kernels pick the signs of the scalar operators for negative frequencies without branches
+
+    // power of a non-negative base given its logarithm, both branches are evaluated so that the select is if-converted
+    DD_INLINE double power(const double base, const double log_base, const double exponent) {
+        const auto value = dd::simd::exp(exponent * log_base);
+        return base == 0. ? 0. : value;
+    }
+
+    // one if base^exponent changes sign for a negative frequency depending on the parity of an order, zero otherwise
+    // the factor 1+flip*(l-1) is then the sign of the frequency l or one
+    double parity(const double order, const bool even) { return (static_cast<unsigned>(order) % 2 == 0) == even ? 1. : 0.; }
+
+    // (1+r)*a/(1+r*b) with a=omega_r^(2*npl+1) and b=omega_r^(2*(npr+npl+1)), signs as in the scalar operators
+    // it is evaluated as (1+r)/(u+r*v) with u=1/|a| and v=b/|a| so that high orders do not overflow away from the peak
+    DD_INLINE double two_sided(const double l, const double omega_r, const double log_r, const double npr, const double npl, const double flip_a, const double flip_b) {
+        const auto r = (2. * npl + 1.) / (2. * npr + 1.);
+        const auto u = dd::simd::exp(-(2. * npl + 1.) * log_r);
+        const auto v = (1. + flip_b * (l - 1.)) * dd::simd::exp((2. * npr + 1.) * log_r);
+
+        const auto value = (1. + flip_a * (l - 1.)) * (1. + r) / (u + r * v);
+        return omega_r == 0. ? 0. : value;
+    }
+
+    DD_MULTIVERSION void response_t0(const double* x, double* out, const qsizetype n, const double omega_p, const double zeta_p) {
+        DD_SIMD_LOOP
+        for(qsizetype i = 0; i < n; ++i) {
+            const auto l = x[i] < 0. ? -1. : 1.;
+            const auto omega_r = std::abs(x[i] / omega_p);
+            out[i] = zeta_p * 2. * l * omega_r / (l * omega_r * omega_r + 1.);
+        }
+    }
+
+    DD_MULTIVERSION void response_t1(const double* x, double* out, const qsizetype n, const double omega_p, const double zeta_p, const double np) {
+        const auto exponent = 2. * np + 1.;
+        // std::pow keeps the sign of a negative base for odd integer exponents and fails for fractional ones
+        const auto negative = std::floor(exponent) != exponent ? std::numeric_limits<double>::quiet_NaN() : std::fmod(exponent, 2.) == 0. ? 1. : -1.;
+        const auto flip = parity(np, false);
+
+        DD_SIMD_LOOP
+        for(qsizetype i = 0; i < n; ++i) {
+            const auto l = x[i] < 0. ? -1. : 1.;
+            const auto omega_r = std::abs(x[i] / omega_p);
+            const auto n0 = 2. * l * omega_r / (l * omega_r * omega_r + 1.);
+            const auto magnitude = std::abs(n0);
+            out[i] = zeta_p * power(magnitude, dd::simd::log(magnitude), exponent) * (n0 < 0. ? negative : 1.) * (1. + flip * (l - 1.));
+        }
+    }
+
+    DD_MULTIVERSION void response_t2(const double* x, double* out, const qsizetype n, const double omega_p, const double zeta_p, const double npr, const double npl) {
+        const auto flip_a = parity(npl, true);
+        const auto flip_b = parity(npr + npl + 1., false);
+
+        DD_SIMD_LOOP
+        for(qsizetype i = 0; i < n; ++i) {
+            const auto l = x[i] < 0. ? -1. : 1.;
+            const auto omega_r = std::abs(x[i] / omega_p);
+            out[i] = zeta_p * two_sided(l, omega_r, dd::simd::log(omega_r), npr, npl, flip_a, flip_b);
+        }
+    }
+
+    DD_MULTIVERSION void response_t3(const double* x, double* out, const qsizetype n, const double omega_p, const double zeta_p, const double gamma) {
+        DD_SIMD_LOOP
+        for(qsizetype i = 0; i < n; ++i) {
+            const auto l = x[i] < 0. ? -1. : 1.;
+            const auto omega_r = std::abs(x[i] / omega_p);
+            const auto n0 = 2. * l * omega_r / (l * omega_r * omega_r + 1.);
+            out[i] = zeta_p * (1. + gamma) * n0 / (1. + gamma * l * n0 * n0);
+        }
+    }
+
+    DD_MULTIVERSION void response_t4(const double* x, double* out, const qsizetype n, const double omega_p, const double zeta_p, const double* p) {
+        const auto npr = p[0], npl = p[1], npk = p[2], npm = p[3], gamma = p[4];
+        const auto flip_sa = parity(npl, true), flip_sb = parity(npr + npl + 1., false);
+        const auto flip_pa = parity(npm, true), flip_pb = parity(npk + npm + 1., false);
+
+        DD_SIMD_LOOP
+        for(qsizetype i = 0; i < n; ++i) {
+            const auto l = x[i] < 0. ? -1. : 1.;
+            const auto omega_r = std::abs(x[i] / omega_p);
+            const auto log_r = dd::simd::log(omega_r);
+            const auto ns = two_sided(l, omega_r, log_r, npr, npl, flip_sa, flip_sb);
+            const auto np = two_sided(l, omega_r, log_r, npk, npm, flip_pa, flip_pb);
+            out[i] = zeta_p * (1. + gamma) * ns / (1. + l * gamma * ns * np);
+        }
+    }
+} // namespace
 
 DampingMode::DampingMode(const double in_omega, const double in_zeta, std::vector<double>&& in_p, const MT in_type)
     : type(in_type), omega_p(in_omega), zeta_p(in_zeta), p(std::forward<std::vector<double>>(in_p)) {}
 
+double DampingMode::frequency() const {
+    return omega_p;
+}
+
+double DampingMode::amplitude() const {
+    return zeta_p;
+}
+
+bool DampingMode::sameShape(const DampingMode& other) const {
+    return type == other.type && p == other.p;
+}
+
 void DampingMode::tidyUp() {}
 
 DampingModeT0::DampingModeT0(const double in_omega, const double in_zeta, std::vector<double>&& in_p)
@@ -27,10 +128,14 @@ DampingModeT0::DampingModeT0(const double in_omega, const double in_zeta, std::v
 
 double DampingModeT0::operator()(const double in_omega) const {
     const auto l = in_omega < 0. ? -1. : 1.;
-    const auto omega_r = abs(in_omega / omega_p);
+    const auto omega_r = std::abs(in_omega / omega_p);
     return zeta_p * 2. * l * omega_r / (l * omega_r * omega_r + 1.);
 }
 
+void DampingModeT0::evaluate(const double* in_omega, double* out_zeta, const qsizetype n) const {
+    response_t0(in_omega, out_zeta, n, omega_p, zeta_p);
+}
+
 QString DampingModeT0::str() const {
     return "Type 0 --- " + QString::number(omega_p) + " " + QString::number(zeta_p);
 }
@@ -44,7 +149,7 @@ DampingModeT1::DampingModeT1(const double in_omega, const double in_zeta, std::v
 
 double DampingModeT1::operator()(const double in_omega) const {
     const auto l = in_omega < 0. ? -1. : 1.;
-    const auto omega_r = abs(in_omega / omega_p);
+    const auto omega_r = std::abs(in_omega / omega_p);
     const auto n0 = 2. * l * omega_r / (l * omega_r * omega_r + 1.);
     auto n1 = pow(n0, 2. * p[0] + 1.);
     if(l < 0. && static_cast<unsigned>(p[0]) % 2 != 0)
@@ -57,6 +162,10 @@ void DampingModeT1::tidyUp() {
     p[0] = round(p[0]);
 }
 
+void DampingModeT1::evaluate(const double* in_omega, double* out_zeta, const qsizetype n) const {
+    response_t1(in_omega, out_zeta, n, omega_p, zeta_p, p[0]);
+}
+
 QString DampingModeT1::str() const {
     return "Type 1 --- " + QString::number(omega_p) + " " + QString::number(zeta_p) + " " + QString::number(p[0]);
 }
@@ -75,7 +184,7 @@ double DampingModeT2::operator()(const double in_omega) const {
     const auto nps = npr + npl + 1.;
 
     const auto l = in_omega < 0. ? -1. : 1.;
-    const auto omega_r = abs(in_omega / omega_p);
+    const auto omega_r = std::abs(in_omega / omega_p);
     auto a = pow(omega_r, 2. * npl + 1.);
     auto b = pow(omega_r, 2. * nps);
 
@@ -94,6 +203,10 @@ void DampingModeT2::tidyUp() {
     p[1] = round(p[1]);
 }
 
+void DampingModeT2::evaluate(const double* in_omega, double* out_zeta, const qsizetype n) const {
+    response_t2(in_omega, out_zeta, n, omega_p, zeta_p, p[0], p[1]);
+}
+
 QString DampingModeT2::str() const {
     return "Type 2 --- " + QString::number(omega_p) + " " + QString::number(zeta_p) + " " + QString::number(p[0]) + " " + QString::number(p[1]);
 }
@@ -108,12 +221,16 @@ DampingModeT3::DampingModeT3(const double in_omega, const double in_zeta, std::v
 double DampingModeT3::operator()(const double in_omega) const {
     const auto& gamma = p[0];
     const auto l = in_omega < 0. ? -1. : 1.;
-    const auto omega_r = abs(in_omega / omega_p);
+    const auto omega_r = std::abs(in_omega / omega_p);
     const auto n0 = 2. * l * omega_r / (l * omega_r * omega_r + 1.);
 
     return zeta_p * (1. + gamma) * n0 / (1. + gamma * l * n0 * n0);
 }
 
+void DampingModeT3::evaluate(const double* in_omega, double* out_zeta, const qsizetype n) const {
+    response_t3(in_omega, out_zeta, n, omega_p, zeta_p, p[0]);
+}
+
 QString DampingModeT3::str() const {
     return "Type 3 --- " + QString::number(omega_p) + " " + QString::number(zeta_p) + " " + QString::number(p[0], 'e', 8);
 }
@@ -136,7 +253,7 @@ double DampingModeT4::operator()(const double in_omega) const {
     const auto rs = (2. * npl + 1.) / (2. * npr + 1.);
     const auto nps = npr + npl + 1.;
 
-    const auto omega_r = abs(in_omega / omega_p);
+    const auto omega_r = std::abs(in_omega / omega_p);
     auto a = pow(omega_r, 2. * npl + 1.);
     auto b = pow(omega_r, 2. * nps);
 
@@ -174,6 +291,10 @@ void DampingModeT4::tidyUp() {
     p[3] = round(p[3]);
 }
 
+void DampingModeT4::evaluate(const double* in_omega, double* out_zeta, const qsizetype n) const {
+    response_t4(in_omega, out_zeta, n, omega_p, zeta_p, p.data());
+}
+
 QString DampingModeT4::str() const {
     return "Type 4 --- " + QString::number(omega_p) + " " + QString::number(zeta_p) + " " + QString::number(p[0]) + " " + QString::number(p[1]) + " " + QString::number(p[2]) + " " + QString::number(p[3]) + " " + QString::number(p[4], 'e', 8);
 }
@@ -181,3 +302,153 @@ QString DampingModeT4::str() const {
 QString DampingModeT4::command() const {
     return "-type4 " + QString::number(zeta_p, 'e', 5) + " " + QString::number(omega_p, 'e', 5) + " " + QString::number(static_cast<int>(p[0])) + " " + QString::number(static_cast<int>(p[1])) + " " + QString::number(static_cast<int>(p[2])) + " " + QString::number(static_cast<int>(p[3])) + " " + QString::number(p[4], 'e', 8);
 }
+
+namespace {
+    static_assert(std::is_trivially_copyable_v<ModeRecord<5>>);
+
+    template<typename M, std::size_t N> std::unique_ptr<DampingMode> rebuild(const ModeRecord<N>& record) {
+        return std::make_unique<M>(record.omega_p, record.zeta_p, std::vector<double>(record.p.cbegin(), record.p.cend()));
+    }
+} // namespace
+
+template<typename T, typename F> decltype(auto) ModeTable::select(T& table, const MT type, F&& action) {
+    switch(type) {
+    case MT::T0:
+        return action(table.t0);
+    case MT::T1:
+        return action(table.t1);
+    case MT::T2:
+        return action(table.t2);
+    case MT::T3:
+        return action(table.t3);
+    default:
+        return action(table.t4);
+    }
+}
+
+void ModeTable::push_back(const DampingMode& mode) {
+    select(*this, mode.type, [&](auto& group) {
+        auto& record = group.emplace_back();
+        record.omega_p = mode.omega_p;
+        record.zeta_p = mode.zeta_p;
+        std::copy_n(mode.p.cbegin(), std::min(record.p.size(), mode.p.size()), record.p.begin());
+        slots.emplace_back(mode.type, static_cast<unsigned>(group.size() - 1));
+    });
+}
+
+void ModeTable::append(const MT type, const mat& parameters) {
+    if(parameters.n_cols < 2) return;
+
+    select(*this, type, [&](auto& group) {
+        group.reserve(group.size() + parameters.n_rows);
+        for(auto I = 0llu; I < parameters.n_rows; ++I) {
+            auto& record = group.emplace_back();
+            record.omega_p = parameters(I, 0);
+            record.zeta_p = parameters(I, 1);
+            for(auto J = 0llu; J < std::min<uword>(record.p.size(), parameters.n_cols - 2); ++J) record.p[J] = parameters(I, J + 2);
+            slots.emplace_back(type, static_cast<unsigned>(group.size() - 1));
+        }
+    });
+}
+
+void ModeTable::erase(const int tag) {
+    const auto [type, slot] = slots.at(tag);
+    select(*this, type, [&](auto& group) { group.erase(group.begin() + slot); });
+    slots.erase(slots.begin() + tag);
+
+    // records of the same type behind the removed one move down by one
+    for(auto& [other_type, other_slot] : slots)
+        if(other_type == type && other_slot > slot) --other_slot;
+}
+
+void ModeTable::clear() {
+    t0.clear();
+    t1.clear();
+    t2.clear();
+    t3.clear();
+    t4.clear();
+    slots.clear();
+}
+
+int ModeTable::size() const {
+    return static_cast<int>(slots.size());
+}
+
+double ModeTable::frequency(const int tag) const {
+    const auto [type, slot] = slots.at(tag);
+    return select(*this, type, [slot](const auto& group) { return group[slot].omega_p; });
+}
+
+double ModeTable::amplitude(const int tag) const {
+    const auto [type, slot] = slots.at(tag);
+    return select(*this, type, [slot](const auto& group) { return group[slot].zeta_p; });
+}
+
+std::pair<MT, std::vector<double>> ModeTable::shape(const int tag) const {
+    const auto [type, slot] = slots.at(tag);
+    return {type, select(*this, type, [slot](const auto& group) { return std::vector<double>(group[slot].p.begin(), group[slot].p.end()); })};
+}
+
+std::vector<int> ModeTable::grouped() const {
+    const std::array<std::size_t, 5> offset{0, t0.size(), t0.size() + t1.size(), t0.size() + t1.size() + t2.size(), t0.size() + t1.size() + t2.size() + t3.size()};
+
+    std::vector<int> order(slots.size());
+    for(auto tag = 0; tag < size(); ++tag) order[offset[static_cast<std::size_t>(slots[tag].first)] + slots[tag].second] = tag;
+
+    return order;
+}
+
+void ModeTable::evaluate(const int tag, const double* in_omega, double* out_zeta, const qsizetype n) const {
+    switch(const auto [type, slot] = slots[tag]; type) {
+    case MT::T0: {
+        const auto& record = t0[slot];
+        response_t0(in_omega, out_zeta, n, record.omega_p, record.zeta_p);
+        break;
+    }
+    case MT::T1: {
+        const auto& record = t1[slot];
+        response_t1(in_omega, out_zeta, n, record.omega_p, record.zeta_p, record.p[0]);
+        break;
+    }
+    case MT::T2: {
+        const auto& record = t2[slot];
+        response_t2(in_omega, out_zeta, n, record.omega_p, record.zeta_p, record.p[0], record.p[1]);
+        break;
+    }
+    case MT::T3: {
+        const auto& record = t3[slot];
+        response_t3(in_omega, out_zeta, n, record.omega_p, record.zeta_p, record.p[0]);
+        break;
+    }
+    case MT::T4: {
+        const auto& record = t4[slot];
+        response_t4(in_omega, out_zeta, n, record.omega_p, record.zeta_p, record.p.data());
+        break;
+    }
+    }
+}
+
+std::unique_ptr<DampingMode> ModeTable::mode(const int tag) const {
+    switch(const auto [type, slot] = slots.at(tag); type) {
+    case MT::T0:
+        return rebuild<DampingModeT0>(t0[slot]);
+    case MT::T1:
+        return rebuild<DampingModeT1>(t1[slot]);
+    case MT::T2:
+        return rebuild<DampingModeT2>(t2[slot]);
+    case MT::T3:
+        return rebuild<DampingModeT3>(t3[slot]);
+    default:
+        return rebuild<DampingModeT4>(t4[slot]);
+    }
+}
+
+void ModeTable::tidyUp() {
+    // the rounding rules live with each type, the tidied parameters are written back into the record
+    for(auto tag = 0; tag < size(); ++tag) {
+        const auto tidy = mode(tag);
+        tidy->tidyUp();
+        const auto [type, slot] = slots[tag];
+        select(*this, type, [&, slot = slot](auto& group) { std::copy_n(tidy->p.cbegin(), group[slot].p.size(), group[slot].p.begin()); });
+    }
+}
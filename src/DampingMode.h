@@ -20,7 +20,14 @@
 
 #include "damping-dolphin.h"
 
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <array>
+
 class DampingMode {
+    friend class ModeTable;
+
 protected:
     const MT type;
     const double omega_p, zeta_p;
@@ -31,6 +38,11 @@ public:
     virtual ~DampingMode() = default;
 
     virtual double operator()(double) const = 0;
+    virtual void evaluate(const double*, double*, qsizetype) const = 0;
+
+    [[nodiscard]] double frequency() const;
+    [[nodiscard]] double amplitude() const;
+    [[nodiscard]] bool sameShape(const DampingMode&) const;
 
     virtual void tidyUp();
 
@@ -43,6 +55,7 @@ public:
     DampingModeT0(double, double, std::vector<double>&&);
 
     double operator()(double) const override;
+    void evaluate(const double*, double*, qsizetype) const override;
 
     QString str() const override;
     QString command() const override;
@@ -53,6 +66,7 @@ public:
     DampingModeT1(double, double, std::vector<double>&&);
 
     double operator()(double) const override;
+    void evaluate(const double*, double*, qsizetype) const override;
 
     void tidyUp() override;
 
@@ -65,6 +79,7 @@ public:
     DampingModeT2(double, double, std::vector<double>&&);
 
     double operator()(double) const override;
+    void evaluate(const double*, double*, qsizetype) const override;
 
     void tidyUp() override;
 
@@ -77,6 +92,7 @@ public:
     DampingModeT3(double, double, std::vector<double>&&);
 
     double operator()(double) const override;
+    void evaluate(const double*, double*, qsizetype) const override;
 
     QString str() const override;
     QString command() const override;
@@ -87,6 +103,7 @@ public:
     DampingModeT4(double, double, std::vector<double>&&);
 
     double operator()(double) const override;
+    void evaluate(const double*, double*, qsizetype) const override;
 
     void tidyUp() override;
 
@@ -94,4 +111,50 @@ public:
     QString command() const override;
 };
 
+// centre, amplitude and the parameters of a mode of one type without any indirection
+template<std::size_t N> struct ModeRecord {
+    double omega_p{0.}, zeta_p{0.};
+    std::array<double, N> p{};
+};
+
+// modes grouped by type, each type is one contiguous array of fixed size records so that
+// a whole set can be copied as plain memory and homogeneous groups are evaluated in turn
+// tags follow the order in which modes are added and map to a type and a slot in its array
+class ModeTable {
+    std::vector<ModeRecord<0>> t0;
+    std::vector<ModeRecord<1>> t1;
+    std::vector<ModeRecord<2>> t2;
+    std::vector<ModeRecord<1>> t3;
+    std::vector<ModeRecord<5>> t4;
+
+    std::vector<std::pair<MT, unsigned>> slots;
+
+    // calls action on the array holding records of the given type
+    template<typename T, typename F> static decltype(auto) select(T&, MT, F&&);
+
+public:
+    void push_back(const DampingMode&);
+    // one mode per row holding the frequency, the damping ratio and then the parameters of the type
+    void append(MT, const mat&);
+    void erase(int);
+    void clear();
+
+    [[nodiscard]] int size() const;
+
+    [[nodiscard]] double frequency(int) const;
+    [[nodiscard]] double amplitude(int) const;
+    // modes with equal keys differ only in frequency and amplitude
+    [[nodiscard]] std::pair<MT, std::vector<double>> shape(int) const;
+
+    // tags ordered by type and then by slot, which is the order records are laid out in memory
+    [[nodiscard]] std::vector<int> grouped() const;
+
+    void evaluate(int, const double*, double*, qsizetype) const;
+
+    // a standalone copy for formatting and scalar queries
+    [[nodiscard]] std::unique_ptr<DampingMode> mode(int) const;
+
+    void tidyUp();
+};
+
 #endif // DAMPINGMODE_H
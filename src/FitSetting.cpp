@@ -91,3 +91,47 @@ void FitSetting::on_changeMaxIter_clicked() {
 
     ui->maxIter->setText(QString::number(maxIter));
 }
+
+void FitSetting::on_changeNumStarts_clicked() {
+    bool flag;
+    const auto numStarts = QInputDialog::getText(this, "Starts", "Input number of starts...").toInt(&flag);
+    if(!flag || numStarts <= 0) {
+        QMessageBox::information(this, tr("Oops!"), tr("The number of starts needs to be a positive integer number."));
+        return;
+    }
+
+    ui->numStarts->setText(QString::number(numStarts));
+}
+
+void FitSetting::on_changeTimeLimit_clicked() {
+    bool flag;
+    const auto timeLimit = QInputDialog::getText(this, "Time Limit", "Input time limit in seconds...").toDouble(&flag);
+    if(!flag || timeLimit < 0.) {
+        QMessageBox::information(this, tr("Oops!"), tr("The time limit needs to be a non-negative float number."));
+        return;
+    }
+
+    ui->timeLimit->setText(QString::number(timeLimit));
+}
+
+void FitSetting::on_changePlateauTolerance_clicked() {
+    bool flag;
+    const auto plateauTolerance = QInputDialog::getText(this, "Plateau", "Input relative improvement...").toDouble(&flag);
+    if(!flag || plateauTolerance < 0.) {
+        QMessageBox::information(this, tr("Oops!"), tr("The relative improvement needs to be a non-negative float number."));
+        return;
+    }
+
+    ui->plateauTolerance->setText(QString::number(plateauTolerance));
+}
+
+void FitSetting::on_changePlateauWindow_clicked() {
+    bool flag;
+    const auto plateauWindow = QInputDialog::getText(this, "Plateau Window", "Input number of evaluations...").toInt(&flag);
+    if(!flag || plateauWindow <= 0) {
+        QMessageBox::information(this, tr("Oops!"), tr("The plateau window needs to be a positive integer number."));
+        return;
+    }
+
+    ui->plateauWindow->setText(QString::number(plateauWindow));
+}
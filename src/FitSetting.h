@@ -39,6 +39,10 @@ private slots:
     void on_changeTolerance_clicked();
     void on_changeMaxOrder_clicked();
     void on_changeMaxIter_clicked();
+    void on_changeNumStarts_clicked();
+    void on_changeTimeLimit_clicked();
+    void on_changePlateauTolerance_clicked();
+    void on_changePlateauWindow_clicked();
 
 private:
     Ui::FitSetting* ui;
@@ -44,17 +44,31 @@ MainWindow::MainWindow(QWidget* parent)
     ui->canvas->xAxis->grid()->setSubGridVisible(true);
     ui->canvas->yAxis->grid()->setSubGridVisible(true);
 
-    updateScale();
+    plot_timer.setSingleShot(true);
+    plot_clock.start();
+    connect(&plot_timer, &QTimer::timeout, this, &MainWindow::drawPlot);
+
+    sample_timer.setSingleShot(true);
+    sample_timer.setInterval(100);
+    connect(&sample_timer, &QTimer::timeout, this, &MainWindow::plotDampingCurve);
 
     plotDampingCurve();
 
     updateOptimizerModeList();
 
+    progress_timer.setInterval(100);
+    connect(&progress_timer, &QTimer::timeout, this, &MainWindow::pollFitting);
+
+    connect(this, &MainWindow::startFitting, this, &MainWindow::trackFitting);
     connect(this, &MainWindow::finishFitting, this, &MainWindow::processFittingResult);
+    connect(ui->canvas->xAxis, qOverload<const QCPRange&>(&QCPAxis::rangeChanged), this, &MainWindow::updateViewport);
 }
 
 MainWindow::~MainWindow() {
     if(optimization_task.valid()) optimization_task.get();
+
+    curve_stop.request_stop();
+    if(curve_task.valid()) curve_task.get();
 }
 
 void MainWindow::savePlot() {
@@ -121,8 +135,11 @@ void MainWindow::loadTypeInfo() {
         return;
     }
 
+    QStringList type_list;
     while(!file.atEnd())
-        addType(QString(file.readLine()));
+        type_list.append(QString(file.readLine()));
+
+    addType(type_list);
 
     statusBar()->showMessage("Successfully read from file.");
 }
@@ -273,9 +290,24 @@ void MainWindow::switchCurveScale() {
         return;
     }
 
+    ui->canvas->xAxis->setRange(ui->minX->text().toDouble(), ui->maxX->text().toDouble());
+
+    plotDampingCurve();
+}
+
+void MainWindow::switchDetail() {
+    ui->samples->setEnabled(ui->switchDetail->checkState() == Qt::Unchecked);
+
     plotDampingCurve();
 }
 
+void MainWindow::updateViewport() {
+    if(ui->switchDetail->checkState() == Qt::Unchecked || curve_graphs != damping_curve.count() + 1)
+        return;
+
+    requestPlot(plot_viewport);
+}
+
 void MainWindow::changeX() {
     bool flag;
 
@@ -308,46 +340,246 @@ void MainWindow::changeX() {
     ui->minX->setText(QString::number(x_min));
     ui->maxX->setText(QString::number(x_max));
 
+    ui->canvas->xAxis->setRange(x_min, x_max);
+
     plotDampingCurve();
 }
 
 void MainWindow::plotDampingCurve() {
+    ui->samplesValue->setText(QString::number(ui->samples->value()));
+
+    curve_visible = true;
+    control_point_visible = false;
+
+    requestPlot(plot_curve | plot_axis);
+}
+
+void MainWindow::changeSamples(const int samples) {
+    ui->samplesValue->setText(QString::number(samples));
+
+    sample_timer.start();
+}
+
+void MainWindow::requestPlot(const unsigned parts) {
+    pending_plot |= parts;
+
+    // a computation still running is outdated by any change to the curve
+    if(parts & plot_curve) {
+        ++curve_generation;
+        curve_stop.request_stop();
+    }
+
+    if(plot_timer.isActive()) return;
+
+    // the first request is drawn as soon as control returns to the event loop, later ones wait for the next frame
+    constexpr qint64 frame_interval = 16;
+    plot_timer.start(static_cast<int>(std::max(qint64{0}, frame_interval - plot_clock.elapsed())));
+}
+
+void MainWindow::drawPlot() {
+    const auto parts = std::exchange(pending_plot, 0u);
+    plot_clock.restart();
+
+    if(parts & plot_axis) updateScale();
+
+    // the curve on screen is only replaced once the new one has been computed
+    if(parts & plot_curve) {
+        if(curve_visible) computeDampingCurve();
+        else drawDampingCurve();
+    }
+    else if((parts & plot_viewport) && ui->switchDetail->checkState() == Qt::Checked && curve_graphs == damping_curve.count() + 1)
+        computeDampingCurve();
+
+    // the control points may have been shown or hidden along with the curve
+    if(parts & (plot_curve | plot_control_point)) drawControlPoint();
+    if(parts & (plot_curve | plot_fit)) drawFitProgress();
+
+    // the range of a curve is known once the curve has been computed
+    if((parts & plot_axis) && !curve_visible) fitRange();
+
+    ui->canvas->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void MainWindow::computeDampingCurve() {
+    // the latest request is started once the cancelled computation has returned
+    if(curve_task.valid()) return;
+
+    const auto geometric = ui->switchCurveScale->checkState() == Qt::Checked;
+    // in the detailed mode, only the visible range is sampled at about one sample per pixel
+    const auto detail = ui->switchDetail->checkState() == Qt::Checked;
+    const auto range = detail ? ui->canvas->xAxis->range() : QCPRange(ui->minX->text().toDouble(), ui->maxX->text().toDouble());
+    const auto samples = static_cast<size_t>(detail ? ui->canvas->axisRect()->width() : ui->samples->value());
+
+    curve_lower = range.lower;
+    curve_upper = range.upper;
+    curve_stop = std::stop_source();
+
+    curve_task = std::async(std::launch::async, [this, curve = std::make_shared<DampingCurve>(damping_curve), generation = curve_generation, stop = curve_stop.get_token(), geometric, detail, range, samples] {
+        if(detail)
+            curve->updateAdaptiveDampingCurve(range.lower, range.upper, samples, geometric, stop);
+        else if(geometric)
+            curve->updateLogarithmicDampingCurve(range.lower, range.upper, samples, stop);
+        else
+            curve->updateLinearDampingCurve(range.lower, range.upper, samples, stop);
+        curve->evaluateModes(stop);
+
+        QMetaObject::invokeMethod(this, [this, generation, curve] { finishDampingCurve(generation, curve); }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::finishDampingCurve(const unsigned generation, const std::shared_ptr<DampingCurve>& curve) {
+    curve_task.get();
+
+    // a result that has been superseded is dropped and the latest request is computed instead
+    if(generation != curve_generation) {
+        if(curve_visible) computeDampingCurve();
+        return;
+    }
+
+    damping_curve = std::move(*curve);
+
+    drawDampingCurve();
+    drawControlPoint();
+    drawFitProgress();
+
+    // the axes are fitted to a new curve but not to a refreshed viewport of the same curve
+    if(std::exchange(shown_generation, generation) != generation) fitRange();
+
+    // the viewport may have moved while the curve was computed
+    if(ui->switchDetail->checkState() == Qt::Checked && ui->canvas->xAxis->range() != QCPRange(curve_lower, curve_upper)) requestPlot(plot_viewport);
+
+    ui->canvas->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void MainWindow::drawDampingCurve() {
+    // graphs drawn over the curve are added again afterwards
+    for(auto* graph : {&control_graph, &fit_graph, &loss_graph})
+        if(*graph) {
+            ui->canvas->removeGraph(*graph);
+            *graph = nullptr;
+        }
+
+    if(!curve_visible) {
+        ui->canvas->clearGraphs();
+        curve_graphs = 0;
+        return;
+    }
+
     QPen pen;
     pen.setWidth(5);
     pen.setColor(QColor(0, 0, 0));
 
-    ui->samplesValue->setText(QString::number(ui->samples->value()));
+    // graphs are kept across replots and refilled in place, only the difference in their number is added or removed
+    const auto curves = static_cast<int>(damping_curve.count()) + 1;
+    while(ui->canvas->graphCount() > curves) ui->canvas->removeGraph(ui->canvas->graphCount() - 1);
+    while(ui->canvas->graphCount() < curves) ui->canvas->addGraph();
+
+    for(auto j = 0; j < curves; ++j) {
+        auto* graph = ui->canvas->graph(j);
+        if(0 == j) graph->setName("Total Response");
+        else {
+            pen = QPen(color_preset[(j - 1) % color_preset.size()]);
+            pen.setWidth(2);
+            pen.setStyle(line_preset[(j - 1) % line_preset.size()]);
+            graph->setName(ui->currentTypes->item(j - 1)->text());
+        }
+        graph->setPen(pen);
+        graph->setLineStyle(QCPGraph::lsLine);
+        graph->setScatterStyle(QCPScatterStyle());
+        damping_curve.fillGraphData(*graph->data(), j - 1);
+    }
+    curve_graphs = curves;
+}
 
-    updateScale();
+void MainWindow::drawControlPoint() {
+    if(!control_point_visible) {
+        if(control_graph) ui->canvas->removeGraph(control_graph);
+        control_graph = nullptr;
+        return;
+    }
+
+    if(!control_graph) {
+        QPen pen;
+        pen.setWidth(5);
+        pen.setColor(QColor(255, 0, 0));
+
+        control_graph = ui->canvas->addGraph();
+        control_graph->setPen(pen);
+        control_graph->setName("Control Point");
+        control_graph->setLineStyle(QCPGraph::LineStyle::lsNone);
+        control_graph->setScatterStyle(QCPScatterStyle::ssStar);
+    }
 
-    const auto x_min = ui->minX->text().toDouble();
-    const auto x_max = ui->maxX->text().toDouble();
+    control_graph->setData(control_point.getFrequencyVector(), control_point.getDampingRatioVector());
+}
 
-    if(ui->switchCurveScale->checkState() == Qt::Unchecked)
-        damping_curve.updateLinearDampingCurve(x_min, x_max, ui->samples->value());
-    else if(ui->switchCurveScale->checkState() == Qt::Checked)
-        damping_curve.updateLogarithmicDampingCurve(x_min, x_max, ui->samples->value());
+void MainWindow::drawFitProgress() {
+    if(!progress_timer.isActive() || fit_loss.isEmpty()) {
+        if(fit_graph) ui->canvas->removeGraph(fit_graph);
+        if(loss_graph) ui->canvas->removeGraph(loss_graph);
+        fit_graph = loss_graph = nullptr;
+        ui->canvas->xAxis2->setVisible(false);
+        ui->canvas->yAxis2->setVisible(false);
+        return;
+    }
 
-    ui->canvas->clearGraphs();
-    ui->canvas->xAxis->setRange(damping_curve.minFrequency(), damping_curve.maxFrequency());
-    ui->canvas->yAxis->setRange(damping_curve.minDampingRatio() - .1, damping_curve.maxDampingRatio() + .1);
+    if(!fit_graph) {
+        QPen pen(QColor(128, 128, 128));
+        pen.setWidth(3);
+        pen.setStyle(Qt::DashLine);
 
-    ui->canvas->addGraph();
-    ui->canvas->graph()->setName("Total Response");
-    ui->canvas->graph()->setPen(pen);
-    ui->canvas->graph()->setData(damping_curve.getFrequencyVector(), damping_curve.getDampingRatioVector());
+        fit_graph = ui->canvas->addGraph();
+        fit_graph->setPen(pen);
+        fit_graph->setName("Fitting");
+    }
 
-    for(auto j = 0; j < damping_curve.count(); ++j) {
-        ui->canvas->addGraph();
-        pen = QPen(color_preset[j % color_preset.size()]);
+    // the loss is plotted against the number of evaluations on the secondary axes
+    if(!loss_graph) {
+        QPen pen(QColor(255, 0, 255));
         pen.setWidth(2);
-        pen.setStyle(line_preset[j % line_preset.size()]);
-        ui->canvas->graph()->setPen(pen);
-        ui->canvas->graph()->setName(ui->currentTypes->item(j)->text());
-        ui->canvas->graph()->setData(damping_curve.getFrequencyVector(), damping_curve.getDampingRatioVector(j));
+
+        loss_graph = ui->canvas->addGraph(ui->canvas->xAxis2, ui->canvas->yAxis2);
+        loss_graph->setPen(pen);
+        loss_graph->setName("Loss");
+
+        ui->canvas->xAxis2->setLabel("Evaluations");
+        ui->canvas->yAxis2->setLabel("Loss");
+        ui->canvas->yAxis2->setScaleType(QCPAxis::stLogarithmic);
+        ui->canvas->yAxis2->setTicker(QSharedPointer<QCPAxisTickerLog>(new QCPAxisTickerLog));
+        ui->canvas->yAxis2->setNumberFormat("eb");
+        ui->canvas->yAxis2->setNumberPrecision(0);
+        ui->canvas->xAxis2->setVisible(true);
+        ui->canvas->yAxis2->setVisible(true);
     }
 
-    ui->canvas->replot();
+    if(ui->switchCurveScale->checkState() == Qt::Checked)
+        fit_curve.updateLogarithmicDampingCurve(ui->minX->text().toDouble(), ui->maxX->text().toDouble(), ui->samples->value());
+    else
+        fit_curve.updateLinearDampingCurve(ui->minX->text().toDouble(), ui->maxX->text().toDouble(), ui->samples->value());
+    fit_curve.fillGraphData(*fit_graph->data());
+
+    loss_graph->setData(fit_evaluation, fit_loss, true);
+    loss_graph->rescaleAxes();
+
+    ui->canvas->yAxis->setRange(fit_curve.minDampingRatio() - .1, fit_curve.maxDampingRatio() + .1);
+}
+
+void MainWindow::fitRange() const {
+    if(curve_visible) {
+        // curves of single modes are only available once drawn
+        if(ui->switchDetail->checkState() == Qt::Unchecked) ui->canvas->xAxis->setRange(damping_curve.minFrequency(), damping_curve.maxFrequency());
+        ui->canvas->yAxis->setRange(damping_curve.minDampingRatio() - .1, damping_curve.maxDampingRatio() + .1);
+        return;
+    }
+
+    if(control_point.count() > 0) {
+        if(ui->switchCurveScale->checkState() == Qt::Unchecked)
+            ui->canvas->xAxis->setRange(control_point.minFrequency() - 1., control_point.maxFrequency() + 1.);
+        else if(ui->switchCurveScale->checkState() == Qt::Checked)
+            ui->canvas->xAxis->setRange(.5 * control_point.minFrequency(), 2. * control_point.maxFrequency());
+    }
+
+    ui->canvas->yAxis->setRange(control_point.minDampingRatio() - .1, control_point.maxDampingRatio() + .1);
 }
 
 void MainWindow::queryDampingRatio() {
@@ -411,22 +643,10 @@ void MainWindow::clearAllControlPoints() {
 }
 
 void MainWindow::scatterControlPoint() {
-    ui->canvas->clearGraphs();
-
-    addControlPointToPlot();
-
-    updateScale();
-
-    if(control_point.count() > 0) {
-        if(ui->switchCurveScale->checkState() == Qt::Unchecked)
-            ui->canvas->xAxis->setRange(control_point.minFrequency() - 1., control_point.maxFrequency() + 1.);
-        else if(ui->switchCurveScale->checkState() == Qt::Checked)
-            ui->canvas->xAxis->setRange(.5 * control_point.minFrequency(), 2. * control_point.maxFrequency());
-    }
+    curve_visible = false;
+    control_point_visible = true;
 
-    ui->canvas->yAxis->setRange(control_point.minDampingRatio() - .1, control_point.maxDampingRatio() + .1);
-
-    ui->canvas->replot();
+    requestPlot(plot_curve | plot_axis);
 }
 
 void MainWindow::about() {
@@ -466,6 +686,8 @@ void MainWindow::performFitting() {
 
     statusBar()->showMessage("Optimizing...");
 
+    fit_progress = std::make_unique<FitProgress<double>>();
+
     optimization_task = std::async(std::launch::async, &MainWindow::performFittingTask, this, reference);
 }
 
@@ -483,6 +705,8 @@ void MainWindow::performFittingTask(const mat& reference) {
     else if(ui->optimizationScheme->currentText() == "Three Wise Men")
         f = std::make_unique<ThreeWiseMen<ET>>(ui->numberT3->value());
 
+    emit startFitting(f->getType());
+
     const auto lower = log10(reference.col(0).min());
     const auto upper = log10(reference.col(0).max());
 
@@ -494,6 +718,14 @@ void MainWindow::performFittingTask(const mat& reference) {
     opt_setting.tolerance = fit_dialog.getUi()->tolerance->text().toDouble();
     opt_setting.weight = fit_dialog.getUi()->weight->text().toDouble();
     opt_setting.maxIter = fit_dialog.getUi()->maxIter->text().toInt();
+    opt_setting.variableProjection = fit_dialog.getUi()->variableProjection->isChecked();
+    opt_setting.numStarts = fit_dialog.getUi()->numStarts->text().toInt();
+    opt_setting.timeLimit = fit_dialog.getUi()->timeLimit->text().toDouble();
+    opt_setting.plateauTolerance = fit_dialog.getUi()->plateauTolerance->text().toDouble();
+    opt_setting.plateauWindow = fit_dialog.getUi()->plateauWindow->text().toInt();
+    opt_setting.dictionarySeed = fit_dialog.getUi()->dictionarySeed->isChecked();
+    opt_setting.printLoss = fit_dialog.getUi()->printLoss->isChecked();
+    opt_setting.locality = fit_dialog.getUi()->modeLocality->isChecked() ? 1E-8 : 0.;
 
     Mat<ET> result;
 
@@ -516,15 +748,21 @@ void MainWindow::performFittingTask(const mat& reference) {
     early_quit = std::stop_source();
 
     if(ui->optimizerList->currentText() == "LBFGS")
-        result = run_optimizer<L_BFGS>(opt_setting, f.get(), early_quit.get_token());
+        result = run_optimizer<L_BFGS>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
+    else if(ui->optimizerList->currentText() == "Levenberg-Marquardt")
+        result = run_optimizer<LevenbergMarquardt>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
     else if(ui->optimizerList->currentText() == "Gradient Descent")
-        result = run_optimizer<GradientDescent>(opt_setting, f.get(), early_quit.get_token());
+        result = run_optimizer<GradientDescent>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
     else if(ui->optimizerList->currentText() == "AugLagrangian")
-        result = run_optimizer<AugLagrangian>(opt_setting, f.get(), early_quit.get_token());
+        result = run_optimizer<AugLagrangian>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
+    else if(ui->optimizerList->currentText() == "CMA-ES")
+        result = run_optimizer<BatchCMAES>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
+    else if(ui->optimizerList->currentText() == "PSO")
+        result = run_optimizer<BatchPSO>(opt_setting, f.get(), early_quit.get_token(), fit_progress.get());
 
     result.print("result");
 
-    emit finishFitting(f->getTypeList(result));
+    emit finishFitting(f->getType(), result);
 }
 
 void MainWindow::loadControlPoint() {
@@ -566,17 +804,43 @@ void MainWindow::updateOptimizerModeList() const {
         ui->numberT3->setEnabled(true);
 }
 
-void MainWindow::processFittingResult(const QStringList& result) {
-    addType(result);
+void MainWindow::trackFitting(const MT type) {
+    fit_type = type;
+    fit_curve.removeMode();
+    fit_evaluation.clear();
+    fit_loss.clear();
+
+    progress_timer.start();
+}
+
+void MainWindow::pollFitting() {
+    const auto* snapshot = fit_progress->poll();
+    if(!snapshot) return;
+
+    fit_curve.removeMode();
+    fit_curve.addModes(fit_type, conv_to<mat>::from(snapshot->parameter));
+    fit_evaluation.push_back(static_cast<double>(snapshot->evaluation));
+    fit_loss.push_back(snapshot->objective);
+
+    statusBar()->showMessage(QString("Optimizing... loss %1 after %2 evaluations.").arg(snapshot->objective).arg(snapshot->evaluation));
+
+    requestPlot(plot_fit);
+}
+
+void MainWindow::processFittingResult(const MT type, const arma::mat& result) {
+    progress_timer.stop();
+
+    addType(type, result);
+    updateTypeList();
 
     addControlPointToPlot();
 
     statusBar()->showMessage("Finished!");
 }
 
-void MainWindow::changeLegend() const {
+void MainWindow::changeLegend() {
     ui->canvas->legend->setVisible(ui->changeLegend->checkState() == Qt::Checked);
-    ui->canvas->replot();
+    requestPlot(plot_legend);
 }
 
 void MainWindow::showGuidelines() {
@@ -614,74 +878,41 @@ void MainWindow::commandOS() {
     ui->commandOutput->setText(command);
 }
 
+void MainWindow::addType(const MT type, const mat& modes) {
+    // rows with a negligible damping ratio are skipped as in addType()
+    const uvec kept = find(abs(modes.col(1)) >= 1E-4);
+
+    damping_curve.addModes(type, modes.rows(kept));
+}
+
 void MainWindow::addType(const QString& type) {
-    QStringList fields = type.split(" ");
+    // "Type k --- frequency damping_ratio parameters", the number of fields is fixed by the type
+    static constexpr std::array<qsizetype, 5> fields_per_type{5, 6, 7, 6, 10};
+
+    const auto fields = type.trimmed().split(" ");
     if(fields.size() < 2) return;
 
-    if(fields[1] == "0") {
-        if(fields.size() < 5) return;
-        ui->typeList->setCurrentIndex(0);
-        ui->omega->setValue(fields[3].toDouble());
-        ui->zeta->setValue(fields[4].toDouble());
-        addType();
-    }
-    else if(fields[1] == "1") {
-        if(fields.size() < 6) return;
-        ui->typeList->setCurrentIndex(1);
-        ui->omega->setValue(fields[3].toDouble());
-        ui->zeta->setValue(fields[4].toDouble());
-        ui->pa->setValue(fields[5].toDouble());
-        addType();
-    }
-    else if(fields[1] == "2") {
-        if(fields.size() < 7) return;
-        ui->typeList->setCurrentIndex(2);
-        ui->omega->setValue(fields[3].toDouble());
-        ui->zeta->setValue(fields[4].toDouble());
-        ui->pa->setValue(fields[5].toDouble());
-        ui->pb->setValue(fields[6].toDouble());
-        addType();
-    }
-    else if(fields[1] == "3") {
-        if(fields.size() < 6) return;
-        ui->typeList->setCurrentIndex(3);
-        ui->omega->setValue(fields[3].toDouble());
-        ui->zeta->setValue(fields[4].toDouble());
-        ui->pe->setValue(fields[5].toDouble());
-        addType();
-    }
-    else if(fields[1] == "4") {
-        if(fields.size() < 10) return;
-        ui->typeList->setCurrentIndex(4);
-        ui->omega->setValue(fields[3].toDouble());
-        ui->zeta->setValue(fields[4].toDouble());
-        ui->pa->setValue(fields[5].toDouble());
-        ui->pb->setValue(fields[6].toDouble());
-        ui->pc->setValue(fields[7].toDouble());
-        ui->pd->setValue(fields[8].toDouble());
-        ui->pe->setValue(fields[9].toDouble());
-        addType();
-    }
+    bool flag;
+    const auto index = fields[1].toInt(&flag);
+    if(!flag || index < 0 || index >= static_cast<int>(fields_per_type.size()) || fields.size() < fields_per_type[index]) return;
+
+    rowvec parameters(fields_per_type[index] - 3);
+    for(auto I = 0llu; I < parameters.n_elem; ++I) parameters(I) = fields[static_cast<qsizetype>(I) + 3].toDouble();
+
+    addType(static_cast<MT>(index), parameters);
 }
 
 void MainWindow::addType(const QStringList& type_list) {
     for(const auto& I : type_list)
         addType(I);
+
+    updateTypeList();
 }
 
 void MainWindow::addControlPointToPlot() {
-    QPen pen;
-    pen.setWidth(5);
-    pen.setColor(QColor(255, 0, 0));
-
-    ui->canvas->addGraph();
-    ui->canvas->graph()->setPen(pen);
-    ui->canvas->graph()->setName("Control Point");
-    ui->canvas->graph()->setLineStyle(QCPGraph::LineStyle::lsNone);
-    ui->canvas->graph()->setScatterStyle(QCPScatterStyle::ssStar);
-    ui->canvas->graph()->setData(control_point.getFrequencyVector(), control_point.getDampingRatioVector());
+    control_point_visible = true;
 
-    ui->canvas->replot();
+    requestPlot(plot_control_point);
 }
 
 void MainWindow::updateScale() const {
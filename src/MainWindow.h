@@ -18,8 +18,10 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QElapsedTimer>
 #include <QMainWindow>
 #include <QStandardItemModel>
+#include <QTimer>
 #include <future>
 #include <stop_token>
 #include "DampingCurve.h"
@@ -32,6 +34,9 @@ namespace Ui {
 }
 QT_END_NAMESPACE
 
+class QCPGraph;
+template<typename ET> class FitProgress;
+
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
@@ -48,6 +53,34 @@ private:
     FitSetting fit_dialog;
 
     DampingCurve damping_curve;
+    // number of leading graphs on the canvas that show the damping curve
+    int curve_graphs{0};
+    // the graph of control points, always drawn after the damping curve
+    QCPGraph* control_graph{nullptr};
+
+    // parts of the canvas to be redrawn, requests are collected and drawn together at most once per frame
+    enum PlotPart : unsigned {
+        plot_curve = 1u << 0,
+        plot_control_point = 1u << 1,
+        plot_axis = 1u << 2,
+        plot_viewport = 1u << 3,
+        plot_fit = 1u << 4,
+        // nothing to recompute, the canvas is only replotted
+        plot_legend = 1u << 5
+    };
+    unsigned pending_plot{0};
+    bool curve_visible{true}, control_point_visible{false};
+    QTimer plot_timer;
+    QElapsedTimer plot_clock;
+
+    // the curve is computed on a copy in the background and swapped in once done, results of superseded requests are dropped
+    std::stop_source curve_stop;
+    std::future<void> curve_task;
+    unsigned curve_generation{0}, shown_generation{0};
+    // the visible range the running computation samples in the detailed mode
+    double curve_lower{0.}, curve_upper{0.};
+    // changes of the sample count are only applied once the slider rests
+    QTimer sample_timer;
 
     ControlPoint control_point;
 
@@ -68,9 +101,26 @@ private:
     std::stop_source early_quit;
     std::future<void> optimization_task;
 
+    // the best modes of a running fit are polled and overlaid together with the history of the loss
+    std::unique_ptr<FitProgress<double>> fit_progress;
+    QTimer progress_timer;
+    MT fit_type{MT::T0};
+    DampingCurve fit_curve;
+    QVector<double> fit_evaluation, fit_loss;
+    QCPGraph* fit_graph{nullptr};
+    QCPGraph* loss_graph{nullptr};
+
+    void addType(MT, const mat&);
     void addType(const QString&);
     void addType(const QStringList&);
     void addControlPointToPlot();
+    void requestPlot(unsigned);
+    void computeDampingCurve();
+    void finishDampingCurve(unsigned, const std::shared_ptr<DampingCurve>&);
+    void drawDampingCurve();
+    void drawControlPoint();
+    void drawFitProgress();
+    void fitRange() const;
     void updateScale() const;
     [[nodiscard]] bool validateScheme() const;
 private slots:
@@ -80,6 +130,8 @@ private slots:
     void clearAllTypes();
     void loadTypeInfo();
     void plotDampingCurve();
+    void drawPlot();
+    void changeSamples(int);
     void queryDampingRatio();
     void removeSelectedControlPoint();
     void removeSelectedType();
@@ -89,21 +141,26 @@ private slots:
     void updateParameterFields(int) const;
     void updateTypeList();
     void switchCurveScale();
+    void switchDetail();
+    void updateViewport();
     void changeX();
     void about();
     void performFitting();
     void performFittingTask(const arma::mat&);
     void loadControlPoint();
     void updateOptimizerModeList() const;
-    void processFittingResult(const QStringList&);
-    void changeLegend() const;
+    void trackFitting(MT);
+    void pollFitting();
+    void processFittingResult(MT, const arma::mat&);
+    void changeLegend();
     void showGuidelines();
     void showFitSetting();
     void tidyUp();
     void commandSP();
     void commandOS();
 signals:
-    void finishFitting(QStringList);
+    void startFitting(MT);
+    void finishFitting(MT, arma::mat);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef BOUNDEDLEASTSQUARES_HPP
+#define BOUNDEDLEASTSQUARES_HPP
+
+#include "../damping-dolphin.h"
+
+namespace dd {
+    // minimises |A*a-b|^2 subject to lower<=a<=upper, given gram=A^T*A and rhs=A^T*b
+    // active set method in the manner of Lawson-Hanson, upper may be infinite for plain NNLS
+    template<typename ET> Col<ET> bounded_least_squares(const Mat<ET>& gram, const Col<ET>& rhs, const ET lower, const ET upper) {
+        const auto n = rhs.n_elem;
+
+        Col<ET> a(n);
+        a.fill(lower);
+
+        // 0: at lower bound, 1: free, 2: at upper bound
+        uvec state(n, fill::zeros);
+
+        const auto tolerance = ET(10) * std::numeric_limits<ET>::epsilon() * std::max(ET(1), norm(gram, "inf")) * std::max(ET(1), abs(rhs).max());
+
+        Col<ET> trial;
+        for(auto counter = 0llu; counter < 3 * n + 10; ++counter) {
+            // negative gradient of 0.5*a^T*gram*a-rhs^T*a
+            const Col<ET> w = rhs - gram * a;
+
+            auto candidate = n;
+            ET largest = tolerance;
+            for(auto I = 0llu; I < n; ++I)
+                if((state(I) == 0 && w(I) > largest) || (state(I) == 2 && -w(I) > largest)) {
+                    candidate = I;
+                    largest = std::abs(w(I));
+                }
+
+            if(candidate == n) break;
+
+            state(candidate) = 1;
+
+            while(true) {
+                const uvec free = find(state == 1);
+                const uvec fixed = find(state != 1);
+
+                Col<ET> reduced = rhs(free);
+                if(!fixed.empty()) reduced -= gram(free, fixed) * a(fixed);
+                if(!solve(trial, gram(free, free), reduced, solve_opts::likely_sympd)) return a;
+
+                // step towards the unconstrained minimiser until the first bound is hit
+                auto step = ET(1);
+                auto limit = free.n_elem;
+                for(auto I = 0llu; I < free.n_elem; ++I) {
+                    const auto current = a(free(I));
+                    auto ratio = step;
+                    if(trial(I) < lower) ratio = (current - lower) / (current - trial(I));
+                    else if(trial(I) > upper) ratio = (upper - current) / (trial(I) - current);
+                    if(ratio < step) {
+                        step = ratio;
+                        limit = I;
+                    }
+                }
+
+                if(limit == free.n_elem) {
+                    a(free) = trial;
+                    break;
+                }
+
+                for(auto I = 0llu; I < free.n_elem; ++I) {
+                    auto& current = a(free(I));
+                    current += step * (trial(I) - current);
+                    if(I == limit) current = trial(I) < lower ? lower : upper;
+                    if(current <= lower) {
+                        current = lower;
+                        state(free(I)) = 0;
+                    }
+                    else if(current >= upper) {
+                        current = upper;
+                        state(free(I)) = 2;
+                    }
+                }
+
+                if(all(state != 1)) break;
+            }
+        }
+
+        return a;
+    }
+} // namespace dd
+
+#endif // BOUNDEDLEASTSQUARES_HPP
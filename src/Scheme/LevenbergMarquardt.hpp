@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef LEVENBERGMARQUARDT_HPP
+#define LEVENBERGMARQUARDT_HPP
+
+#include "../damping-dolphin.h"
+
+// trust region Levenberg-Marquardt for functions providing EvaluateWithJacobian()
+// the objective is the sum of squared residuals, the damping follows Nielsen's update
+class LevenbergMarquardt {
+    size_t max_iterations;
+    double tolerance;
+    double initial_damping;
+
+public:
+    explicit LevenbergMarquardt(const size_t max_iterations = 1000, const double tolerance = 1E-8, const double initial_damping = 1E-3)
+        : max_iterations(max_iterations)
+        , tolerance(tolerance)
+        , initial_damping(initial_damping) {}
+
+    [[nodiscard]] size_t MaxIterations() const { return max_iterations; }
+    size_t& MaxIterations() { return max_iterations; }
+
+    [[nodiscard]] double Tolerance() const { return tolerance; }
+    double& Tolerance() { return tolerance; }
+
+    [[nodiscard]] double InitialDamping() const { return initial_damping; }
+    double& InitialDamping() { return initial_damping; }
+
+    // functions report through SparseJacobian(x) whether most of the Jacobian at x is structurally zero
+    template<typename FunctionType, typename MatType, typename... CallbackTypes>
+    typename MatType::elem_type Optimize(FunctionType& function, MatType& x, CallbackTypes&&... callbacks) {
+        using ET = typename MatType::elem_type;
+
+        if(function.SparseJacobian(x)) return optimize<SpMat<ET>>(function, x, callbacks...);
+
+        return optimize<Mat<ET>>(function, x, callbacks...);
+    }
+
+private:
+    template<typename JacobianType, typename FunctionType, typename MatType, typename... CallbackTypes>
+    typename MatType::elem_type optimize(FunctionType& function, MatType& x, CallbackTypes&... callbacks) {
+        using ET = typename MatType::elem_type;
+
+        Col<ET> r;
+        JacobianType jacobian;
+        Mat<ET> hessian, gradient;
+        Col<ET> scale, step;
+
+        auto terminate = dd::begin_optimization(*this, function, x, callbacks...);
+
+        const auto linearize = [&] {
+            const auto value = function.EvaluateWithJacobian(x, r, jacobian);
+            hessian = Mat<ET>(jacobian.t() * jacobian);
+            gradient = jacobian.t() * r;
+            return value;
+        };
+
+        auto value = linearize();
+        terminate |= Callback::Evaluate(*this, function, x, value, callbacks...);
+
+        // Marquardt scaling uses the largest diagonal seen so far to stay invariant to parameter scaling
+        scale = clamp(hessian.diag(), std::numeric_limits<ET>::epsilon(), std::numeric_limits<ET>::max());
+
+        auto mu = ET(initial_damping) * max(scale);
+        auto nu = ET(2);
+
+        for(size_t I = 0; I < max_iterations && !terminate; ++I) {
+            if(norm(gradient, "inf") <= tolerance) break;
+
+            Mat<ET> system = hessian;
+            system.diag() += mu * scale;
+
+            if(!solve(step, system, -gradient, solve_opts::likely_sympd + solve_opts::no_approx)) {
+                mu *= nu;
+                nu *= ET(2);
+                continue;
+            }
+
+            const Mat<ET> trial = x + step;
+            const auto trial_value = function.Evaluate(trial);
+            terminate |= Callback::Evaluate(*this, function, trial, trial_value, callbacks...);
+
+            // reduction predicted by the linearized residual
+            const auto predicted = dot(step, mu * scale % step - gradient);
+            const auto ratio = (value - trial_value) / predicted;
+
+            if(!std::isfinite(trial_value) || !(ratio > ET(0))) {
+                mu *= nu;
+                nu *= ET(2);
+                if(!std::isfinite(mu)) break;
+                continue;
+            }
+
+            const auto converged = value - trial_value <= tolerance * value || norm(step) <= tolerance * (norm(x) + tolerance);
+
+            x = trial;
+            value = linearize();
+            scale = max(scale, hessian.diag());
+
+            Mat<ET> full_gradient = ET(2) * gradient;
+            terminate |= Callback::Gradient(*this, function, x, full_gradient, callbacks...);
+            terminate |= Callback::StepTaken(*this, function, x, callbacks...);
+
+            mu *= std::max(ET(1) / ET(3), ET(1) - std::pow(ET(2) * ratio - ET(1), 3));
+            nu = ET(2);
+
+            if(converged) break;
+        }
+
+        Callback::EndOptimization(*this, function, x, callbacks...);
+
+        return value;
+    }
+};
+
+#endif // LEVENBERGMARQUARDT_HPP
@@ -18,26 +18,343 @@
 #ifndef OBJECTIVEFUNCTION_H
 #define OBJECTIVEFUNCTION_H
 
+#include <mutex>
 #include "../damping-dolphin.h"
+#include "BoundedLeastSquares.hpp"
+#include "parallel_for.hpp"
+
+template<typename ET> class VariableProjection;
 
 template<typename ET> class ObjectiveFunction {
+    friend class VariableProjection<ET>;
+
 protected:
     const unsigned num_modes;
 
-    Mat<ET> sampling, response;
+    Mat<ET> sampling;
+
+    Col<ET> frequency, target;
 
     ET min_omega{0}, max_omega{0}, min_zeta{0}, max_zeta{0};
     ET range_omega{0};
 
-    uvec base;
-
     ET weight{0};
 
     int max_order = 10;
 
+    // samples are processed in blocks of fixed size, the last block is padded with zero residual
+    static constexpr uword block_size = 256;
+
+    uword num_samples{0}, num_blocks{0};
+
+    // log of the constant ratio between consecutive frequencies on a geometric grid, zero for any other grid
+    ET log_step{0};
+
+    // contributions below this fraction of the peak target are dropped, zero evaluates every mode everywhere
+    ET locality{0};
+
+    // mapped parameters of all modes and their derivatives, one mode per column
+    // owned by each evaluation so that a single objective can serve concurrent evaluations
+    // each mode is only evaluated at samples [first, last)
+    struct Transform {
+        Mat<ET> parameter, derivative;
+        uvec first, last;
+    };
+
+    // the last evaluated point, optimizers often query the value and the gradient at the same point separately
+    // the lock is never held across parallel sections, a copy starts empty
+    struct Cache {
+        std::mutex lock;
+        Mat<ET> x, g;
+        ET value{0};
+        bool has_gradient = false;
+
+        Cache() = default;
+        Cache(const Cache&) {}
+
+        [[nodiscard]] bool contains(const Mat<ET>& point) const { return point.n_elem == x.n_elem && std::equal(point.begin(), point.end(), x.begin()); }
+    };
+
+    mutable Cache cache;
+
+    bool load_cache(const Mat<ET>& x, ET& value, Mat<ET>* g) const {
+        std::scoped_lock guard(cache.lock);
+        if(!cache.contains(x) || (g && !cache.has_gradient)) return false;
+        value = cache.value;
+        if(g) *g = cache.g;
+        return true;
+    }
+    void store_cache(const Mat<ET>& x, const ET value, const Mat<ET>* g) const {
+        std::scoped_lock guard(cache.lock);
+        cache.x = x;
+        cache.value = value;
+        cache.has_gradient = g != nullptr;
+        if(g) cache.g = *g;
+    }
+    void invalidate() const {
+        std::scoped_lock guard(cache.lock);
+        cache.x.reset();
+        cache.has_gradient = false;
+    }
+
+    // per thread block workspace, every mode owns (size + 1) contiguous columns holding
+    // the response followed by the derivatives, the last column holds the residual
+    // only used inside leaf tasks which never spawn nested parallel work
+    static Mat<ET>& workspace() {
+        thread_local Mat<ET> block;
+        return block;
+    }
+
+    [[nodiscard]] Transform transform(const ET* x) const {
+        const auto num_para = getSize();
+
+        Transform t{Mat<ET>(num_para, num_modes), Mat<ET>(num_para, num_modes), {}, {}};
+        for(auto J = 0u; J < num_modes; ++J) {
+            s(x + num_para * J, t.parameter.colptr(J));
+            ds(x + num_para * J, t.derivative.colptr(J));
+        }
+
+        localize(t);
+
+        return t;
+    }
+    [[nodiscard]] Transform transform(const Mat<ET>& x) const { return transform(x.memptr()); }
+
+    void localize(Transform& t) const {
+        t.first.zeros(num_modes);
+        t.last.set_size(num_modes);
+        t.last.fill(num_samples);
+
+        const auto threshold = locality * abs(target).max();
+        if(threshold <= ET(0)) return;
+
+        // frequencies are sorted so that the support maps to a contiguous range of samples
+        const auto begin = frequency.begin(), end = frequency.begin() + num_samples;
+        for(auto J = 0u; J < num_modes; ++J) {
+            ET lower, upper;
+            support(t.parameter.colptr(J), threshold, lower, upper);
+            t.first(J) = std::lower_bound(begin, end, lower) - begin;
+            t.last(J) = std::max(t.first(J), uword(std::upper_bound(begin, end, upper) - begin));
+        }
+    }
+
+    // the sparse Jacobian only pays off when the supports cover a small fraction of the samples
+    [[nodiscard]] bool sparse(const Transform& t) const { return locality > ET(0) && accu(t.last - t.first) < num_samples * num_modes / 10; }
+
+    // rows [a, b) of the block starting at offset covered by mode J
+    [[nodiscard]] std::pair<uword, uword> block_range(const Transform& t, const unsigned J, const uword offset) const { return {std::clamp(t.first(J), offset, offset + block_size) - offset, std::clamp(t.last(J), offset, offset + block_size) - offset}; }
+
+    virtual void kernel_response(const ET*, uword, const ET*, ET*) const = 0;
+    virtual void kernel_gradient(const ET*, uword, const ET*, ET*, uword) const = 0;
+
+    // frequency interval outside which the magnitude of the response of mapped parameters sp stays below threshold
+    // lower > upper when the mode is negligible everywhere
+    virtual void support(const ET*, const ET, ET& lower, ET& upper) const {
+        lower = ET(0);
+        upper = std::numeric_limits<ET>::infinity();
+    }
+
+    // adds the penalty gradient to g unless g is empty
+    virtual ET penalty(const Transform&, Mat<ET>&) const { return ET(0); }
+
+    // the penalty written as extra residual rows so that their sum of squares equals penalty()
+    [[nodiscard]] virtual uword penalty_size() const { return 0; }
+    virtual void penalty_residual(const Transform&, ET*, Mat<ET>&, uword) const {}
+
+    // inverse of the sigmoid used by s(), the argument is kept away from the saturated ends
+    static ET logit(const ET y) {
+        const auto clamped = std::clamp(y, ET(1E-4), ET(1) - ET(1E-4));
+        return log(clamped / (ET(1) - clamped));
+    }
+
+    // candidate values of the parameters following the frequency and the amplitude, one candidate per column
+    [[nodiscard]] virtual Mat<ET> dictionary_shape() const { return Mat<ET>(getSize() - 2, 1); }
+
+    // squared residual of one sample block
+    ET block_value(const Transform& t, const uword B) const {
+        const auto offset = B * block_size;
+
+        auto& block = workspace();
+        block.set_size(block_size, 2);
+
+        Col<ET> fi(block.colptr(1), block_size, false, true);
+        fi = -target.subvec(offset, size(fi));
+        for(auto J = 0u; J < num_modes; ++J) {
+            const auto [a, b] = block_range(t, J, offset);
+            if(a == b) continue;
+            kernel_response(frequency.memptr() + offset + a, b - a, t.parameter.colptr(J), block.colptr(0));
+            fi.subvec(a, b - 1) += block.col(0).head(b - a);
+        }
+        if(offset + block_size > num_samples) fi.tail(offset + block_size - num_samples).zeros();
+
+        return dot(fi, fi);
+    }
+
+    ET evaluate_value(const Transform& t) const {
+        const auto value = dd::parallel_reduce(0llu, num_blocks, ET(0), [&](const uword B, ET& sum) { sum += block_value(t, B); }, std::plus<ET>());
+
+        Mat<ET> g;
+
+        return value + penalty(t, g);
+    }
+
+    ET evaluate_gradient(const Transform& t, Mat<ET>& g) const {
+        const auto num_para = getSize();
+        const auto num_cols = (num_para + 1) * num_modes;
+
+        // the last entry accumulates the squared residual
+        const Col<ET> projection = dd::parallel_reduce(
+            0llu, num_blocks, Col<ET>(num_cols + 1, fill::zeros), [&](const uword B, Col<ET>& sum) {
+                const auto offset = B * block_size;
+
+                auto& block = workspace();
+                block.set_size(block_size, num_cols + 1);
+
+                Col<ET> fi(block.colptr(num_cols), block_size, false, true);
+                fi = -target.subvec(offset, size(fi));
+
+                auto covered = true;
+                for(auto J = 0u; J < num_modes; ++J) {
+                    const auto [a, b] = block_range(t, J, offset);
+                    covered &= a == 0 && b == block_size;
+                    if(a == b) continue;
+                    kernel_gradient(frequency.memptr() + offset + a, b - a, t.parameter.colptr(J), block.colptr((num_para + 1) * J) + a, block_size);
+                    fi.subvec(a, b - 1) += block.col((num_para + 1) * J).subvec(a, b - 1);
+                }
+                if(offset + block_size > num_samples) fi.tail(offset + block_size - num_samples).zeros();
+
+                if(covered) sum += block.t() * fi;
+                else {
+                    sum(num_cols) += dot(fi, fi);
+                    for(auto J = 0u; J < num_modes; ++J) {
+                        const auto [a, b] = block_range(t, J, offset);
+                        if(a != b) sum.subvec((num_para + 1) * J, arma::size(num_para + 1, 1)) += block.submat(a, (num_para + 1) * J, b - 1, (num_para + 1) * J + num_para).t() * fi.subvec(a, b - 1);
+                    }
+                }
+            },
+            [](const Col<ET>& a, const Col<ET>& b) -> Col<ET> { return a + b; });
+
+        g.set_size(num_para * num_modes, 1);
+        for(auto J = 0u; J < num_modes; ++J)
+            for(auto K = 0u; K < num_para; ++K) g(num_para * J + K) = ET(2) * projection((num_para + 1) * J + K + 1) * t.derivative(K, J);
+
+        return projection(num_cols) + penalty(t, g);
+    }
+
+    // residual with the responses restricted to the support of each mode
+    void evaluate_residual(const Transform& t, Col<ET>& r) const {
+        r.set_size(num_samples + penalty_size());
+
+        dd::parallel_for(0llu, num_blocks, [&](const uword B) {
+            const auto offset = B * block_size;
+            const auto num_rows = std::min(block_size, num_samples - offset);
+
+            auto& block = workspace();
+            block.set_size(block_size, 1);
+
+            auto fi = r.subvec(offset, arma::size(num_rows, 1));
+            fi = -target.subvec(offset, arma::size(fi));
+            for(auto J = 0u; J < num_modes; ++J) {
+                auto [a, b] = block_range(t, J, offset);
+                b = std::min(b, num_rows);
+                if(a >= b) continue;
+                kernel_response(frequency.memptr() + offset + a, b - a, t.parameter.colptr(J), block.memptr());
+                fi.subvec(a, b - 1) += block.col(0).head(b - a);
+            }
+        });
+    }
+
+    // calls fill(J, K, a, column) for every stretch of at most block_size samples starting at a within the support of mode J
+    template<typename F> void for_each_jacobian_stretch(const Transform& t, F&& fill) const {
+        const auto num_para = getSize();
+
+        dd::parallel_for(0u, num_modes, [&](const unsigned J) {
+            auto& block = workspace();
+            block.set_size(block_size, num_para + 1);
+
+            for(auto a = t.first(J); a < t.last(J); a += block_size) {
+                const auto n = std::min(block_size, t.last(J) - a);
+                kernel_gradient(frequency.memptr() + a, n, t.parameter.colptr(J), block.memptr(), block_size);
+                for(auto K = 0u; K < num_para; ++K) fill(J, K, a, t.derivative(K, J) * block.col(K + 1).head(n));
+            }
+        });
+    }
+
+    ET evaluate_jacobian(const Transform& t, Col<ET>& r, Mat<ET>& jacobian) const {
+        const auto num_para = getSize();
+
+        evaluate_residual(t, r);
+
+        jacobian.zeros(r.n_elem, num_para * num_modes);
+        for_each_jacobian_stretch(t, [&](const unsigned J, const unsigned K, const uword a, const Col<ET>& column) { jacobian.col(num_para * J + K).subvec(a, arma::size(column)) = column; });
+
+        penalty_residual(t, r.memptr() + num_samples, jacobian, num_samples);
+
+        return dot(r, r);
+    }
+
+    // sparse counterpart, the column of parameter skip is left out of the layout
+    ET evaluate_jacobian(const Transform& t, Col<ET>& r, SpMat<ET>& jacobian, const unsigned skip = std::numeric_limits<unsigned>::max()) const {
+        const auto num_para = getSize();
+        const auto num_kept = skip < num_para ? num_para - 1 : num_para;
+        const auto num_penalty = penalty_size();
+
+        evaluate_residual(t, r);
+
+        Mat<ET> penalty_block(num_penalty, num_para * num_modes, fill::zeros);
+        penalty_residual(t, r.memptr() + num_samples, penalty_block, 0);
+
+        // compressed column layout, the support rows of each column are followed by its penalty rows
+        const auto column = [&](const unsigned J, const unsigned K) { return num_kept * J + K - (K > skip ? 1 : 0); };
+
+        uvec col_ptr(num_kept * num_modes + 1, fill::zeros);
+        std::vector<uvec> penalty_rows(num_para * num_modes);
+        for(auto J = 0u; J < num_modes; ++J)
+            for(auto K = 0u; K < num_para; ++K) {
+                if(K == skip) continue;
+                penalty_rows[num_para * J + K] = find(penalty_block.col(num_para * J + K));
+                col_ptr(column(J, K) + 1) = t.last(J) - t.first(J) + penalty_rows[num_para * J + K].n_elem;
+            }
+        col_ptr = cumsum(col_ptr);
+
+        uvec row_index(col_ptr.back());
+        Col<ET> values(col_ptr.back());
+        for_each_jacobian_stretch(t, [&](const unsigned J, const unsigned K, const uword a, const Col<ET>& stretch) {
+            if(K == skip) return;
+            const auto start = col_ptr(column(J, K)) + a - t.first(J);
+            row_index.subvec(start, arma::size(stretch)) = regspace<uvec>(a, a + stretch.n_elem - 1);
+            values.subvec(start, arma::size(stretch)) = stretch;
+        });
+        for(auto J = 0u; J < num_modes; ++J)
+            for(auto K = 0u; K < num_para; ++K) {
+                const auto& rows = penalty_rows[num_para * J + K];
+                if(K == skip || rows.empty()) continue;
+                const auto start = col_ptr(column(J, K)) + t.last(J) - t.first(J);
+                row_index.subvec(start, arma::size(rows)) = rows + num_samples;
+                values.subvec(start, arma::size(rows)) = penalty_block.col(num_para * J + K).eval()(rows);
+            }
+
+        jacobian = SpMat<ET>(row_index, col_ptr, values, r.n_elem, num_kept * num_modes);
+
+        return dot(r, r);
+    }
+
 public:
-    [[nodiscard]] virtual Col<ET> s(const Col<ET>& p) const { return p; }
-    [[nodiscard]] virtual Col<ET> ds(const Col<ET>& p) const { return ones<Col<ET>>(size(p)); }
+    virtual void s(const ET* p, ET* sp) const { std::copy_n(p, getSize(), sp); }
+    virtual void ds(const ET*, ET* dsp) const { std::fill_n(dsp, getSize(), ET(1)); }
+
+    virtual void inverse_s(const ET* sp, ET* p) const { std::copy_n(sp, getSize(), p); }
+
+    [[nodiscard]] Col<ET> s(const Col<ET>& p) const {
+        Col<ET> sp(size(p));
+        s(p.memptr(), sp.memptr());
+        return sp;
+    }
+    [[nodiscard]] Col<ET> ds(const Col<ET>& p) const {
+        Col<ET> dsp(size(p));
+        ds(p.memptr(), dsp.memptr());
+        return dsp;
+    }
 
     explicit ObjectiveFunction(const unsigned S)
         : num_modes(S) {}
@@ -45,37 +362,164 @@ public:
 
     void initializeSampling(Mat<ET>&& T) {
         sampling = std::move(T);
-        response.set_size(num_modes, sampling.n_cols);
+
+        num_samples = sampling.n_cols;
+        num_blocks = (num_samples + block_size - 1) / block_size;
+
+        frequency.set_size(num_blocks * block_size);
+        frequency.head(num_samples) = sampling.row(0).t();
+        frequency.tail(frequency.n_elem - num_samples).fill(frequency(num_samples - 1));
+        target.zeros(frequency.n_elem);
+        target.head(num_samples) = sampling.row(1).t();
+
         min_omega = log10(min(sampling.row(0))) - .1;
         max_omega = log10(max(sampling.row(0))) + .1;
         min_zeta = min(sampling.row(1));
         max_zeta = max(sampling.row(1));
         range_omega = max_omega - min_omega;
 
-        base = linspace<uvec>(0, num_modes - 1, num_modes);
+        // grids built by logspace() let kernels replace per-sample powers by products
+        log_step = ET(0);
+        if(num_samples > 2) {
+            const Col<ET> log_frequency = log(frequency.head(num_samples));
+            const auto step = (log_frequency(num_samples - 1) - log_frequency(0)) / ET(num_samples - 1);
+            if(step > ET(0) && max(abs(log_frequency - log_frequency(0) - step * regspace<Col<ET>>(0, num_samples - 1))) < ET(1E3) * std::numeric_limits<ET>::epsilon()) log_step = step;
+        }
+
+        invalidate();
     }
 
-    void setWeight(const ET W) { weight = W; }
-    void setMaxOrder(const int M) { max_order = M; }
+    void setWeight(const ET W) {
+        weight = W;
+        invalidate();
+    }
+    void setMaxOrder(const int M) {
+        max_order = M;
+        invalidate();
+    }
+    void setLocality(const ET L) {
+        locality = L;
+        invalidate();
+    }
 
     [[nodiscard]] virtual unsigned getSize() const = 0;
     [[nodiscard]] unsigned getNumberModes() const { return num_modes; }
 
+    // greedy non-negative selection of single mode responses from a dictionary spanning
+    // a log-spaced grid of centre frequencies and all shapes, returns the unmapped parameters
+    // modes that cannot reduce the residual any further are spread over the grid with vanishing amplitude
+    [[nodiscard]] Mat<ET> dictionarySeed() const {
+        static constexpr auto per_decade = 10;
+
+        const auto num_para = getSize();
+        const Mat<ET> shape = dictionary_shape();
+        const auto num_omega = std::max(uword(2), static_cast<uword>(std::ceil(range_omega * per_decade)));
+        const auto num_atoms = num_omega * shape.n_cols;
+
+        Mat<ET> atom_parameter(num_para, num_atoms);
+        for(auto I = 0llu; I < num_omega; ++I)
+            for(auto J = 0llu; J < shape.n_cols; ++J) {
+                auto candidate = atom_parameter.col(I * shape.n_cols + J);
+                candidate(0) = pow(ET(10), min_omega + range_omega * (ET(I) + ET(.5)) / ET(num_omega));
+                candidate(1) = ET(1);
+                candidate.tail(num_para - 2) = shape.col(J);
+            }
+
+        Mat<ET> atom(num_samples, num_atoms);
+        dd::parallel_for(0llu, num_atoms, [&](const uword I) { kernel_response(frequency.memptr(), num_samples, atom_parameter.colptr(I), atom.colptr(I)); });
+
+        const Col<ET> norm_atom = sqrt(sum(square(atom)).t());
+        const Col<ET> reference = target.head(num_samples);
+
+        Col<ET> residual = reference;
+        Col<ET> amplitude;
+        uvec selected;
+        for(auto K = 0u; K < num_modes; ++K) {
+            Col<ET> correlation = atom.t() * residual / clamp(norm_atom, std::numeric_limits<ET>::min(), std::numeric_limits<ET>::max());
+            correlation(selected).fill(ET(0));
+
+            const auto best = correlation.index_max();
+            if(correlation(best) <= ET(0)) break;
+
+            selected.resize(selected.n_elem + 1);
+            selected.back() = best;
+
+            const Mat<ET> basis = atom.cols(selected);
+            amplitude = dd::bounded_least_squares<ET>(basis.t() * basis, basis.t() * reference, ET(0), max_zeta);
+            residual = reference - basis * amplitude;
+        }
+
+        Mat<ET> x(num_para * num_modes, 1);
+        for(auto J = 0llu; J < num_modes; ++J) {
+            Col<ET> sp = atom_parameter.col(J < selected.n_elem ? selected(J) : J * num_omega / num_modes * shape.n_cols);
+            sp(1) = J < selected.n_elem ? amplitude(J) : ET(0);
+            inverse_s(sp.memptr(), &x(num_para * J));
+        }
+
+        return x;
+    }
+
     [[nodiscard]] virtual size_t NumConstraints() const { return 0; }
 
     virtual ET Evaluate(const Mat<ET>& x) {
-        Mat<ET> g;
+        ET value;
+        if(load_cache(x, value, nullptr)) return value;
+
+        value = evaluate_value(transform(x));
+        store_cache(x, value, nullptr);
 
-        return EvaluateWithGradient(x, g);
+        return value;
     }
     virtual void Gradient(const Mat<ET>& x, Mat<ET>& g) { EvaluateWithGradient(x, g); }
 
+    // scores every column of candidates in a single parallel sweep over all candidates and sample blocks
+    virtual void EvaluateBatch(const Mat<ET>& candidates, Col<ET>& objective) {
+        const auto num_candidates = candidates.n_cols;
+
+        std::vector<Transform> t(num_candidates);
+        for(auto I = 0llu; I < num_candidates; ++I) t[I] = transform(candidates.colptr(I));
+
+        // each task owns one slot so that the summation order is fixed
+        Mat<ET> partial(num_blocks, num_candidates);
+        dd::parallel_for(0llu, num_candidates * num_blocks, [&](const uword I) { partial(I) = block_value(t[I / num_blocks], I % num_blocks); });
+
+        objective = sum(partial).t();
+
+        Mat<ET> g;
+        for(auto I = 0llu; I < num_candidates; ++I) objective(I) += penalty(t[I], g);
+    }
+
     virtual ET EvaluateConstraint(const size_t, const Mat<ET>&) { return ET(0); }
     virtual void GradientConstraint(const size_t, const Mat<ET>& x, Mat<ET>& g) { g.zeros(size(x)); }
 
-    virtual ET EvaluateWithGradient(const Mat<ET>&, Mat<ET>&) = 0;
+    virtual ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) {
+        ET value;
+        if(load_cache(x, value, &g)) return value;
+
+        value = evaluate_gradient(transform(x), g);
+        store_cache(x, value, &g);
+
+        return value;
+    }
+
+    // residual of all samples followed by penalty rows, and the Jacobian of the residual
+    virtual ET EvaluateWithJacobian(const Mat<ET>& x, Col<ET>& r, Mat<ET>& jacobian) {
+        const auto value = evaluate_jacobian(transform(x), r, jacobian);
+        store_cache(x, value, nullptr);
+
+        return value;
+    }
+    virtual ET EvaluateWithJacobian(const Mat<ET>& x, Col<ET>& r, SpMat<ET>& jacobian) {
+        const auto value = evaluate_jacobian(transform(x), r, jacobian);
+        store_cache(x, value, nullptr);
+
+        return value;
+    }
+
+    [[nodiscard]] bool SparseJacobian(const Mat<ET>& x) const { return sparse(transform(x)); }
 
-    [[nodiscard]] virtual QStringList getTypeList(const Mat<ET>&) const = 0;
+    // type of the modes in a result, whose rows hold the frequency, the damping ratio and then the remaining parameters
+    [[nodiscard]] virtual MT getType() const = 0;
 };
 
 #endif // OBJECTIVEFUNCTION_H
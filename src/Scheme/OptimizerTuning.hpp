@@ -18,9 +18,16 @@
 #ifndef OPTIMIZERTUNING_H
 #define OPTIMIZERTUNING_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <stop_token>
 #include <utility>
+#include "LevenbergMarquardt.hpp"
 #include "ObjectiveFunction.h"
+#include "PopulationOptimizer.hpp"
+#include "VariableProjection.hpp"
 
 struct OptimizerSetting {
     int maxOrder = 5;
@@ -28,6 +35,14 @@ struct OptimizerSetting {
     double tolerance = 1E-8;
     double stepSize = 1E-3;
     double weight = 1E-4;
+    bool variableProjection = false;
+    int numStarts = 1;
+    bool dictionarySeed = true;
+    double locality = 0.;
+    bool printLoss = false;
+    double timeLimit = 0.;        // wall clock budget in seconds, zero disables
+    double plateauTolerance = 0.; // relative improvement below which a start is regarded stalled, zero disables
+    int plateauWindow = 500;      // number of evaluations without such an improvement before stopping
 };
 
 template<typename T> void NumBasis(T&, int) {}
@@ -44,11 +59,18 @@ template<typename T> void MaxIterations(T& optimizer, const int maxIter) {
     optimizer.MaxIterations() = maxIter;
 }
 
+template<typename T> void Seed(T&, std::uint64_t) {}
+
 template<> inline void NumBasis(L_BFGS& T, const int num_basis) { T.NumBasis() = num_basis; }
 template<> inline void StepSize(L_BFGS&, double) {}
 template<> inline void Tolerance(L_BFGS&, double) {}
 template<> inline void StepSize(AugLagrangian&, double) {}
 template<> inline void Tolerance(AugLagrangian&, double) {}
+template<> inline void StepSize(LevenbergMarquardt&, double) {}
+template<> inline void StepSize(BatchCMAES&, double) {}
+template<> inline void StepSize(BatchPSO&, double) {}
+template<> inline void Seed(BatchCMAES& T, const std::uint64_t seed) { T.Generator().seed(seed); }
+template<> inline void Seed(BatchPSO& T, const std::uint64_t seed) { T.Generator().seed(seed); }
 
 template<typename MatType>
 class EarlyQuit {
@@ -71,21 +93,308 @@ public:
     bool StepTaken(OptimizerType&, FunctionType&, const MatType&) { return if_quit.stop_requested(); }
 };
 
-template<typename T, typename ET> Mat<ET> run_optimizer(const OptimizerSetting& opt_setting, ObjectiveFunction<ET>* f, std::stop_token token) {
+// stops once the wall clock passes a deadline shared by all starts
+template<typename MatType>
+class Deadline {
+    std::chrono::steady_clock::time_point deadline;
+
+    [[nodiscard]] bool passed() const { return std::chrono::steady_clock::now() >= deadline; }
+
+public:
+    explicit Deadline(const std::chrono::steady_clock::time_point until)
+        : deadline(until) {}
+
+    template<typename OptimizerType, typename FunctionType>
+    bool BeginOptimization(OptimizerType&, FunctionType&, const MatType&) { return passed(); }
+
+    template<typename OptimizerType, typename FunctionType>
+    bool Evaluate(OptimizerType&, FunctionType&, const MatType&, double) { return passed(); }
+
+    template<typename OptimizerType, typename FunctionType, typename GradType>
+    bool Gradient(OptimizerType&, FunctionType&, const MatType&, const GradType&) { return passed(); }
+
+    template<typename OptimizerType, typename FunctionType>
+    bool StepTaken(OptimizerType&, FunctionType&, const MatType&) { return passed(); }
+};
+
+// stops once the best objective has improved by less than the relative tolerance over the given number of evaluations
+template<typename MatType>
+class Plateau {
+    using ET = typename MatType::elem_type;
+
+    const ET tolerance;
+    const size_t window;
+
+    ET reference = std::numeric_limits<ET>::max();
+    size_t counter = 0;
+
+public:
+    Plateau(const ET relative, const size_t length)
+        : tolerance(relative)
+        , window(length) {}
+
+    template<typename OptimizerType, typename FunctionType>
+    bool Evaluate(OptimizerType&, FunctionType&, const MatType&, const double objective) {
+        if(tolerance <= ET(0) || window == 0) return false;
+
+        // small improvements do not restart the window but add up until they become significant
+        if(ET(objective) < reference - tolerance * std::abs(reference)) {
+            reference = ET(objective);
+            counter = 0;
+            return false;
+        }
+
+        return ++counter >= window;
+    }
+};
+
+// records the best point evaluated, an optimizer stopped by a callback may be left at a worse trial point
+template<typename MatType>
+class KeepBest {
+    using ET = typename MatType::elem_type;
+
+    MatType& coordinates;
+    ET& objective;
+
+public:
+    KeepBest(MatType& best, ET& value)
+        : coordinates(best)
+        , objective(value) {}
+
+    template<typename OptimizerType, typename FunctionType>
+    bool Evaluate(OptimizerType&, FunctionType&, const MatType& x, const double value) {
+        if(ET(value) < objective) {
+            objective = ET(value);
+            coordinates = x;
+        }
+        return false;
+    }
+};
+
+// shares the best objective among concurrent starts
+// a start is abandoned once its own best stays far behind the shared best after a warm up
+template<typename MatType>
+class SharedBest {
+    using ET = typename MatType::elem_type;
+
+    std::atomic<ET>& best;
+    ET local_best = std::numeric_limits<ET>::max();
+
+    const ET lag_factor;
+    const size_t patience;
+    size_t counter = 0;
+
+public:
+    explicit SharedBest(std::atomic<ET>& shared, const ET lag = ET(10), const size_t warm_up = 200)
+        : best(shared)
+        , lag_factor(lag)
+        , patience(warm_up) {}
+
+    template<typename OptimizerType, typename FunctionType>
+    bool Evaluate(OptimizerType&, FunctionType&, const MatType&, const double objective) {
+        local_best = std::min(local_best, ET(objective));
+
+        auto current = best.load(std::memory_order_relaxed);
+        while(local_best < current && !best.compare_exchange_weak(current, local_best, std::memory_order_relaxed)) {}
+
+        return ++counter > patience && local_best > lag_factor * current;
+    }
+};
+
+// the best modes of a running fit, written by the optimizer and read by the GUI without locking
+// three slots rotate so that the writer never waits for the reader and the reader always gets a complete snapshot
+template<typename ET> class FitProgress {
+public:
+    struct Snapshot {
+        Mat<ET> parameter; // one mode per row
+        ET objective = std::numeric_limits<ET>::max();
+        size_t evaluation = 0;
+    };
+
+private:
+    // improvements are published at most this often as converting coordinates to modes may cost an evaluation
+    static constexpr std::chrono::milliseconds interval{50};
+
+    // marks the middle slot as holding a snapshot the reader has not seen yet
+    static constexpr unsigned fresh = 4u;
+
+    std::array<Snapshot, 3> slot;
+    unsigned back = 0u, front = 1u;
+    std::atomic<unsigned> middle{2u};
+
+    // concurrent starts take turns to write, a start finding the slot busy skips its update
+    std::atomic_flag writing;
+    std::atomic<ET> best{std::numeric_limits<ET>::max()};
+    std::atomic<size_t> evaluations{0};
+    std::atomic<std::chrono::steady_clock::rep> next{0};
+
+public:
+    // counts one evaluation and publishes modes() if the objective improves on everything published so far
+    template<typename F> void publish(const ET objective, F&& modes) {
+        const auto evaluation = evaluations.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        if(objective >= best.load(std::memory_order_relaxed)) return;
+
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        if(now.count() < next.load(std::memory_order_relaxed) || writing.test_and_set(std::memory_order_acquire)) return;
+
+        if(objective < best.load(std::memory_order_relaxed)) {
+            best.store(objective, std::memory_order_relaxed);
+            next.store((now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval)).count(), std::memory_order_relaxed);
+
+            auto& snapshot = slot[back];
+            snapshot.parameter = modes();
+            snapshot.objective = objective;
+            snapshot.evaluation = evaluation;
+            back = middle.exchange(back | fresh, std::memory_order_acq_rel) & ~fresh;
+        }
+
+        writing.clear(std::memory_order_release);
+    }
+
+    // the latest snapshot if a new one has been published since the last call, only one reader is supported
+    [[nodiscard]] const Snapshot* poll() {
+        if(!(middle.load(std::memory_order_relaxed) & fresh)) return nullptr;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~fresh;
+        return &slot[front];
+    }
+};
+
+// reports every evaluation of a start to the progress, modes(x) converts the coordinates of the optimizer to modes
+template<typename ET, typename F> class ReportProgress {
+    FitProgress<ET>* progress;
+    F modes;
+
+public:
+    ReportProgress(FitProgress<ET>* target, F convert)
+        : progress(target)
+        , modes(std::move(convert)) {}
+
+    template<typename OptimizerType, typename FunctionType, typename MatType>
+    bool Evaluate(OptimizerType&, FunctionType&, const MatType& coordinates, const double objective) {
+        if(progress) progress->publish(ET(objective), [&] { return modes(coordinates); });
+        return false;
+    }
+};
+
+template<typename ET> struct FitResult {
+    Mat<ET> parameter; // one mode per row
+    ET objective;
+};
+
+template<typename ET> struct MultiStartResult {
+    Mat<ET> parameter;  // best start, one mode per row
+    Col<ET> objective;  // final objective of every start, abandoned starts included
+};
+
+// the augmented lagrangian reports penalised values to its callbacks, the best point by that value may be infeasible
+template<typename T> inline constexpr bool keeps_best = !std::is_same_v<T, AugLagrangian>;
+
+// seeds the generators of stochastic optimizers from the global generator on the calling thread
+inline std::uint64_t optimizer_seed() { return static_cast<std::uint64_t>(randi<uvec>(1, distr_param(0, std::numeric_limits<int>::max()))(0)); }
+
+inline std::chrono::steady_clock::time_point fit_deadline(const OptimizerSetting& opt_setting) {
+    if(opt_setting.timeLimit <= 0.) return std::chrono::steady_clock::time_point::max();
+
+    return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opt_setting.timeLimit));
+}
+
+template<typename ET> Mat<ET> initial_guess(const OptimizerSetting& opt_setting, ObjectiveFunction<ET>* f, const bool seeded) {
+    const auto num_para = f->getSize();
+
+    Mat<ET> x = seeded ? f->dictionarySeed() : ET(2) * randn<Mat<ET>>(num_para * f->getNumberModes());
+
+    // the amplitude is not an unknown under variable projection
+    if(opt_setting.variableProjection) x.shed_rows(regspace<uvec>(1, num_para, x.n_elem - 1));
+
+    return x;
+}
+
+template<typename T, typename ET, typename... CallbackTypes> FitResult<ET> run_start(const OptimizerSetting& opt_setting, ObjectiveFunction<ET>* f, FitProgress<ET>* progress, Mat<ET> x, const std::uint64_t seed, CallbackTypes&&... callbacks) {
     T optimizer;
+    Seed(optimizer, seed);
     NumBasis(optimizer, 20);
     StepSize(optimizer, opt_setting.stepSize);
     Tolerance(optimizer, opt_setting.tolerance);
     MaxIterations(optimizer, opt_setting.maxIter);
 
+    Mat<ET> best;
+    auto best_objective = std::numeric_limits<ET>::max();
+
+    const auto optimize = [&](auto& g, const auto& modes) -> FitResult<ET> {
+        const auto window = static_cast<size_t>(std::max(0, opt_setting.plateauWindow));
+        if constexpr(keeps_best<T>) optimizer.Optimize(g, x, ReportProgress(progress, modes), KeepBest(best, best_objective), Plateau<Mat<ET>>(ET(opt_setting.plateauTolerance), window), callbacks...);
+        else optimizer.Optimize(g, x, ReportProgress(progress, modes), Plateau<Mat<ET>>(ET(opt_setting.plateauTolerance), window), callbacks...);
+
+        // the recorded point replaces the final one only if its raw objective is lower
+        const auto objective = g.Evaluate(x);
+        if(!best.empty())
+            if(const auto candidate = g.Evaluate(best); candidate < objective) return {modes(best), candidate};
+        return {modes(x), objective};
+    };
+
+    if(opt_setting.variableProjection) {
+        VariableProjection<ET> g(*f);
+
+        return optimize(g, [&](const Mat<ET>& y) -> Mat<ET> { return g.parameter(y).t(); });
+    }
+
+    return optimize(*f, [&](const Mat<ET>& y) -> Mat<ET> { return reshape(y, f->getSize(), f->getNumberModes()).eval().each_col([&](Col<ET>& a) { a = f->s(a); }).t(); });
+}
+
+template<typename T, typename ET> MultiStartResult<ET> run_multistart(const OptimizerSetting& opt_setting, ObjectiveFunction<ET>* f, std::stop_token token, FitProgress<ET>* progress = nullptr) {
+    const auto num_starts = static_cast<uword>(std::max(1, opt_setting.numStarts));
+
+    // the budget covers seeding as well, starts not begun in time return their starting points
+    const auto deadline = fit_deadline(opt_setting);
+
     f->setWeight(opt_setting.weight);
     f->setMaxOrder(opt_setting.maxOrder);
+    f->setLocality(opt_setting.locality);
+
+    // starting points and the seeds of the starts are drawn up front so that the result does not depend on scheduling
+    // only the first start uses the dictionary seed, the others explore from random points
+    std::vector<Mat<ET>> start(num_starts);
+    for(auto I = 0llu; I < num_starts; ++I) start[I] = initial_guess(opt_setting, f, opt_setting.dictionarySeed && I == 0);
+    const auto seed = optimizer_seed();
+
+    std::atomic best(std::numeric_limits<ET>::max());
+
+    std::vector<FitResult<ET>> result(num_starts);
+
+    // evaluations are reentrant so that all starts share the same objective
+    dd::parallel_for(0llu, num_starts, [&](const uword I) { result[I] = run_start<T>(opt_setting, f, progress, std::move(start[I]), seed + I, SharedBest<Mat<ET>>(best), Deadline<Mat<ET>>(deadline), EarlyQuit<Mat<ET>>(token)); });
+
+    MultiStartResult<ET> summary;
+    summary.objective.set_size(num_starts);
+    for(auto I = 0llu; I < num_starts; ++I) summary.objective(I) = result[I].objective;
+    summary.parameter = std::move(result[summary.objective.index_min()].parameter);
+
+    return summary;
+}
+
+template<typename T, typename ET> Mat<ET> run_optimizer(const OptimizerSetting& opt_setting, ObjectiveFunction<ET>* f, std::stop_token token, FitProgress<ET>* progress = nullptr) {
+    if(opt_setting.numStarts > 1) {
+        auto result = run_multistart<T>(opt_setting, f, std::move(token), progress);
+
+        if(opt_setting.printLoss) std::cout << "objective of " << result.objective.n_elem << " starts, best " << result.objective.min() << ", median " << median(result.objective) << ", worst " << result.objective.max() << ".\n";
+
+        return std::move(result.parameter);
+    }
+
+    f->setWeight(opt_setting.weight);
+    f->setMaxOrder(opt_setting.maxOrder);
+    f->setLocality(opt_setting.locality);
+
+    const auto deadline = fit_deadline(opt_setting);
 
-    Mat<ET> x = ET(2) * randn<Mat<ET>>(f->getSize() * f->getNumberModes());
+    auto x = initial_guess(opt_setting, f, opt_setting.dictionarySeed);
 
-    optimizer.Optimize(*f, x, PrintLoss(), EarlyQuit<decltype(x)>(token));
+    // writing every evaluation to the console slows down fits with cheap evaluations
+    if(opt_setting.printLoss) return run_start<T>(opt_setting, f, progress, std::move(x), optimizer_seed(), PrintLoss(), Deadline<Mat<ET>>(deadline), EarlyQuit<Mat<ET>>(std::move(token))).parameter;
 
-    return reshape(x, f->getSize(), f->getNumberModes()).eval().each_col([&](Col<ET>& a) { a = f->s(a); }).t();
+    return run_start<T>(opt_setting, f, progress, std::move(x), optimizer_seed(), Deadline<Mat<ET>>(deadline), EarlyQuit<Mat<ET>>(std::move(token))).parameter;
 }
 
 #endif // OPTIMIZERTUNING_H
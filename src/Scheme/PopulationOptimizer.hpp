@@ -0,0 +1,244 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef POPULATIONOPTIMIZER_HPP
+#define POPULATIONOPTIMIZER_HPP
+
+#include <random>
+#include "../damping-dolphin.h"
+
+// derivative free optimizers for functions providing EvaluateBatch()
+// each generation is scored by a single call so that the whole population shares one parallel sweep
+// callbacks see the best objective of every generation, StepTaken() is invoked whenever it improves
+// each optimizer draws from its own generator so that concurrent runs neither share state nor depend on scheduling
+
+namespace dd {
+    template<typename MatType, typename Distribution> MatType draw(std::mt19937_64& generator, const uword n_rows, const uword n_cols, Distribution distribution) {
+        MatType sample(n_rows, n_cols);
+        sample.imbue([&] { return distribution(generator); });
+        return sample;
+    }
+} // namespace dd
+
+// (mu/mu_w, lambda) CMA-ES with rank-one and rank-mu covariance updates
+class BatchCMAES {
+    size_t max_iterations;
+    double tolerance;
+    double sigma;
+    size_t population_size;
+    std::mt19937_64 generator;
+
+public:
+    explicit BatchCMAES(const size_t max_iterations = 1000, const double tolerance = 1E-8, const double sigma = 1., const size_t population_size = 0)
+        : max_iterations(max_iterations)
+        , tolerance(tolerance)
+        , sigma(sigma)
+        , population_size(population_size) {}
+
+    [[nodiscard]] size_t MaxIterations() const { return max_iterations; }
+    size_t& MaxIterations() { return max_iterations; }
+
+    [[nodiscard]] double Tolerance() const { return tolerance; }
+    double& Tolerance() { return tolerance; }
+
+    [[nodiscard]] double Sigma() const { return sigma; }
+    double& Sigma() { return sigma; }
+
+    // zero picks 4+3ln(n)
+    [[nodiscard]] size_t PopulationSize() const { return population_size; }
+    size_t& PopulationSize() { return population_size; }
+
+    std::mt19937_64& Generator() { return generator; }
+
+    template<typename FunctionType, typename MatType, typename... CallbackTypes>
+    typename MatType::elem_type Optimize(FunctionType& function, MatType& x, CallbackTypes&&... callbacks) {
+        using ET = typename MatType::elem_type;
+
+        const auto n = x.n_elem;
+        const auto lambda = population_size > 0 ? population_size : 4 + static_cast<size_t>(3. * std::log(double(n)));
+        const auto mu = lambda / 2;
+
+        Col<ET> w = log(ET(mu) + ET(.5)) - log(regspace<Col<ET>>(1, mu));
+        w /= accu(w);
+        const auto mueff = ET(1) / accu(square(w));
+
+        const auto N = ET(n);
+        const auto cc = (ET(4) + mueff / N) / (N + ET(4) + ET(2) * mueff / N);
+        const auto cs = (mueff + ET(2)) / (N + mueff + ET(5));
+        const auto c1 = ET(2) / ((N + ET(1.3)) * (N + ET(1.3)) + mueff);
+        const auto cmu = std::min(ET(1) - c1, ET(2) * (mueff - ET(2) + ET(1) / mueff) / ((N + ET(2)) * (N + ET(2)) + mueff));
+        const auto damps = ET(1) + ET(2) * std::max(ET(0), std::sqrt((mueff - ET(1)) / (N + ET(1))) - ET(1)) + cs;
+        const auto chin = std::sqrt(N) * (ET(1) - ET(1) / (ET(4) * N) + ET(1) / (ET(21) * N * N));
+
+        Col<ET> mean = vectorise(x), pc(n, fill::zeros), ps(n, fill::zeros), eigval;
+        Mat<ET> C(n, n, fill::eye), B(n, n, fill::eye);
+        Col<ET> D(n, fill::ones);
+        auto step = ET(sigma);
+
+        Col<ET> objective;
+
+        auto terminate = dd::begin_optimization(*this, function, x, callbacks...);
+
+        auto best = function.Evaluate(x);
+        terminate |= Callback::Evaluate(*this, function, x, best, callbacks...);
+
+        for(size_t I = 0; I < max_iterations && !terminate; ++I) {
+            const Mat<ET> y = B * diagmat(D) * dd::draw<Mat<ET>>(generator, n, lambda, std::normal_distribution<ET>());
+            Mat<ET> candidate = step * y;
+            candidate.each_col() += mean;
+
+            function.EvaluateBatch(candidate, objective);
+
+            const uvec order = sort_index(objective);
+            const auto generation_best = objective(order(0));
+
+            const Mat<ET> leader = reshape(candidate.col(order(0)), size(x));
+
+            terminate |= Callback::Evaluate(*this, function, leader, generation_best, callbacks...);
+
+            if(generation_best < best) {
+                best = generation_best;
+                x = leader;
+                terminate |= Callback::StepTaken(*this, function, x, callbacks...);
+            }
+
+            const Mat<ET> selected = y.cols(order.head(mu));
+            const Col<ET> yw = selected * w;
+
+            mean += step * yw;
+
+            ps = (ET(1) - cs) * ps + std::sqrt(cs * (ET(2) - cs) * mueff) * (B * ((B.t() * yw) / D));
+            const auto ps_norm = norm(ps);
+            const auto hsig = ps_norm / std::sqrt(ET(1) - std::pow(ET(1) - cs, ET(2 * (I + 1)))) / chin < ET(1.4) + ET(2) / (N + ET(1));
+            pc = (ET(1) - cc) * pc + (hsig ? std::sqrt(cc * (ET(2) - cc) * mueff) : ET(0)) * yw;
+
+            C = (ET(1) - c1 - cmu + (hsig ? ET(0) : c1 * cc * (ET(2) - cc))) * C + c1 * pc * pc.t() + cmu * selected * diagmat(w) * selected.t();
+            C = symmatu(C);
+
+            step *= std::exp(cs / damps * (ps_norm / chin - ET(1)));
+
+            if(!eig_sym(eigval, B, C)) break;
+            D = sqrt(clamp(eigval, std::numeric_limits<ET>::epsilon(), std::numeric_limits<ET>::max()));
+
+            if(!std::isfinite(step) || step * D.max() < tolerance || objective(order(lambda - 1)) - generation_best < tolerance * std::abs(generation_best)) break;
+        }
+
+        Callback::EndOptimization(*this, function, x, callbacks...);
+
+        return best;
+    }
+};
+
+// global best particle swarm with Clerc's constriction coefficients
+class BatchPSO {
+    size_t max_iterations;
+    double tolerance;
+    double spread;
+    size_t num_particles;
+    size_t patience;
+    std::mt19937_64 generator;
+
+public:
+    explicit BatchPSO(const size_t max_iterations = 1000, const double tolerance = 1E-8, const double spread = 2., const size_t num_particles = 64, const size_t patience = 50)
+        : max_iterations(max_iterations)
+        , tolerance(tolerance)
+        , spread(spread)
+        , num_particles(num_particles)
+        , patience(patience) {}
+
+    [[nodiscard]] size_t MaxIterations() const { return max_iterations; }
+    size_t& MaxIterations() { return max_iterations; }
+
+    [[nodiscard]] double Tolerance() const { return tolerance; }
+    double& Tolerance() { return tolerance; }
+
+    // standard deviation of the initial swarm around the starting point
+    [[nodiscard]] double Spread() const { return spread; }
+    double& Spread() { return spread; }
+
+    [[nodiscard]] size_t NumParticles() const { return num_particles; }
+    size_t& NumParticles() { return num_particles; }
+
+    // generations without relative improvement larger than the tolerance before stopping
+    [[nodiscard]] size_t Patience() const { return patience; }
+    size_t& Patience() { return patience; }
+
+    std::mt19937_64& Generator() { return generator; }
+
+    template<typename FunctionType, typename MatType, typename... CallbackTypes>
+    typename MatType::elem_type Optimize(FunctionType& function, MatType& x, CallbackTypes&&... callbacks) {
+        using ET = typename MatType::elem_type;
+
+        constexpr auto chi = ET(.7298);
+        constexpr auto c = ET(2.05);
+
+        const auto n = x.n_elem;
+
+        Mat<ET> position = ET(spread) * dd::draw<Mat<ET>>(generator, n, num_particles, std::normal_distribution<ET>());
+        position.each_col() += vectorise(x);
+        position.col(0) = vectorise(x);
+
+        Mat<ET> velocity(n, num_particles, fill::zeros);
+
+        Col<ET> objective;
+
+        auto terminate = dd::begin_optimization(*this, function, x, callbacks...);
+
+        function.EvaluateBatch(position, objective);
+
+        Mat<ET> personal = position;
+        Col<ET> personal_objective = objective;
+
+        auto index = personal_objective.index_min();
+        auto best = personal_objective(index);
+        x = reshape(personal.col(index), size(x));
+
+        terminate |= Callback::Evaluate(*this, function, x, best, callbacks...);
+
+        size_t stalled = 0;
+        for(size_t I = 0; I < max_iterations && !terminate && stalled < patience; ++I) {
+            velocity = chi * (velocity + c * dd::draw<Mat<ET>>(generator, n, num_particles, std::uniform_real_distribution<ET>()) % (personal - position) + c * dd::draw<Mat<ET>>(generator, n, num_particles, std::uniform_real_distribution<ET>()) % (personal.col(index) * ones<Row<ET>>(num_particles) - position));
+            position += velocity;
+
+            function.EvaluateBatch(position, objective);
+
+            const uvec improved = find(objective < personal_objective);
+            personal.cols(improved) = position.cols(improved);
+            personal_objective(improved) = objective(improved);
+
+            index = personal_objective.index_min();
+
+            const Mat<ET> leader = reshape(personal.col(index), size(x));
+
+            terminate |= Callback::Evaluate(*this, function, leader, personal_objective(index), callbacks...);
+
+            if(personal_objective(index) < best) {
+                stalled = best - personal_objective(index) > tolerance * std::abs(best) ? 0 : stalled + 1;
+                best = personal_objective(index);
+                x = leader;
+                terminate |= Callback::StepTaken(*this, function, x, callbacks...);
+            }
+            else ++stalled;
+        }
+
+        Callback::EndOptimization(*this, function, x, callbacks...);
+
+        return best;
+    }
+};
+
+#endif // POPULATIONOPTIMIZER_HPP
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef SHIFTCONVOLUTION_HPP
+#define SHIFTCONVOLUTION_HPP
+
+#include "../damping-dolphin.h"
+
+namespace dd {
+    // smaller groups of modes sharing one shape are cheaper to evaluate directly
+    inline constexpr unsigned convolution_threshold = 128;
+
+    // sizes with no prime factor above five keep the FFT on its fast radices
+    inline bool smooth(uword size) {
+        for(const auto factor : {2llu, 3llu, 5llu})
+            while(size % factor == 0) size /= factor;
+        return size == 1;
+    }
+
+    // adds sum_j z(j)*shape(log(x(i)/w(j))) to out on the geometric grid x(i)=exp(log_x0+i*step), i<n
+    // shape(u0, count, values) evaluates the common shape at u0+k*step for k<count
+    // each centre is split into a whole number of samples and a fraction, the fraction is spread over four
+    // neighbouring spikes by cubic Lagrange interpolation and the spike train is convolved with the sampled shape
+    // modes centred further than n samples away from the grid are evaluated directly
+    template<typename ET, typename F> void shift_sum(const ET log_x0, const ET step, const uword n, const Col<ET>& log_w, const Col<ET>& z, F&& shape, ET* out) {
+        const auto reach = static_cast<ET>(n);
+
+        const Col<ET> position = (log_w - log_x0) / step;
+
+        Col<ET> direct;
+        std::vector<uword> spread;
+        auto low = std::numeric_limits<sword>::max(), high = std::numeric_limits<sword>::min();
+        for(auto J = 0llu; J < position.n_elem; ++J) {
+            if(z(J) == ET(0)) continue;
+            if(position(J) < -reach || position(J) >= ET(2) * reach) {
+                direct.set_size(n);
+                shape(log_x0 - log_w(J), n, direct.memptr());
+                for(auto I = 0llu; I < n; ++I) out[I] += z(J) * direct(I);
+                continue;
+            }
+            const auto whole = static_cast<sword>(std::floor(position(J)));
+            low = std::min(low, whole);
+            high = std::max(high, whole);
+            spread.push_back(J);
+        }
+
+        if(spread.empty()) return;
+
+        // spikes at whole shifts [low-1, high+2]
+        Col<ET> spike(high - low + 4, fill::zeros);
+        for(const auto J : spread) {
+            const auto whole = std::floor(position(J));
+            const auto f = position(J) - whole;
+            auto* s = spike.memptr() + (static_cast<sword>(whole) - low);
+            s[0] -= z(J) * f * (f - ET(1)) * (f - ET(2)) / ET(6);
+            s[1] += z(J) * (f + ET(1)) * (f - ET(1)) * (f - ET(2)) / ET(2);
+            s[2] -= z(J) * (f + ET(1)) * f * (f - ET(2)) / ET(2);
+            s[3] += z(J) * (f + ET(1)) * f * (f - ET(1)) / ET(6);
+        }
+
+        // shape at whole offsets [-high-2, n-low]
+        const auto first = -high - 2;
+        Col<ET> table(n + high - low + 3);
+        shape(static_cast<ET>(first) * step, table.n_elem, table.memptr());
+
+        // the outputs needed never wrap around in a circular convolution as long as size covers the table
+        auto size = table.n_elem;
+        while(!smooth(size)) ++size;
+
+        // both real sequences are transformed at once as the real and imaginary parts of a single one
+        const Col<std::complex<ET>> packed = fft(Col<std::complex<ET>>(resize(spike, size, 1), resize(table, size, 1)));
+        Col<std::complex<ET>> product(size);
+        for(auto K = 0llu; K < size; ++K) {
+            const auto a = packed(K), b = std::conj(packed((size - K) % size));
+            product(K) = (a + b) * (a - b) / std::complex<ET>(ET(0), ET(4));
+        }
+
+        const Col<ET> response = real(ifft(product));
+
+        const auto offset = static_cast<uword>(high - low + 3);
+        for(auto I = 0llu; I < n; ++I) out[I] += response(I + offset);
+    }
+} // namespace dd
+
+#endif // SHIFTCONVOLUTION_HPP
@@ -19,11 +19,34 @@
 #define THREEWISEMEN_H
 
 #include "ObjectiveFunction.h"
-#include "parallel_for.hpp"
+#include "simd.hpp"
 
 template<typename ET> class ThreeWiseMen : public ObjectiveFunction<ET> {
     static constexpr unsigned num_para = 3;
 
+protected:
+    void kernel_response(const ET* x, const uword n, const ET* p, ET* out) const override { compute_response(x, n, p, out); }
+    void kernel_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) const override { compute_gradient(x, n, p, out, ld); }
+
+    // (1+g)c/(c^2+g)=q with c=cosh(log(wr)) has the larger root ((1+g)+sqrt((1+g)^2-4gq^2))/(2q)
+    void support(const ET* sp, const ET threshold, ET& lower, ET& upper) const override {
+        const auto q = threshold / sp[1];
+        const auto g = sp[2];
+        const auto discriminant = (ET(1) + g) * (ET(1) + g) - ET(4) * g * q * q;
+        if(discriminant < ET(0)) {
+            lower = std::numeric_limits<ET>::infinity();
+            upper = ET(0);
+            return;
+        }
+
+        const auto c = std::max(ET(1), (ET(1) + g + std::sqrt(discriminant)) / (ET(2) * q));
+        const auto root = std::sqrt(c * c - ET(1));
+        lower = sp[0] * (c - root);
+        upper = sp[0] * (c + root);
+    }
+
+    [[nodiscard]] Mat<ET> dictionary_shape() const override { return Row<ET>{-.9, -.6, 0., 1., 4., 9.}; }
+
 public:
     static ET compute_response(const ET x, const Col<ET>& p) {
         const auto& w = p(0);
@@ -36,84 +59,72 @@ public:
 
         return z * (ET(1) + g) * coshlog / (coshlog * coshlog + g);
     }
-    static Col<ET> compute_gradient(const ET x, const Col<ET>& p) {
-        Col<ET> out(num_para + 1);
+    DD_MULTIVERSION static void compute_response(const ET* x, const uword n, const ET* p, ET* out) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto g = p[2];
 
-        const auto& w = p(0);
-        const auto& z = p(1);
-        const auto& g = p(2);
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto omega_r = x[I] / w;
+            const auto coshlog = (omega_r * omega_r + ET(1)) / (ET(2) * omega_r);
 
-        const auto omega_r = x / w;
-        const auto logw = log(omega_r);
-        const auto coshlog = cosh(logw);
-        const auto factor = coshlog * coshlog + g;
-
-        out(2) = (ET(1) + g) * coshlog / factor;
-        out(0) = z * out(2);
-        out(1) = z * (ET(1) + g) * (coshlog * coshlog - g) * sinh(logw) / w * pow(factor, -ET(2));
-        out(3) = coshlog * (coshlog * coshlog - ET(1)) * z * pow(factor, -ET(2));
-
-        return out;
+            out[I] = z * (ET(1) + g) * coshlog / (coshlog * coshlog + g);
+        }
     }
-
-    [[nodiscard]] Col<ET> s(const Col<ET>& p) const override {
-        Col<ET> sp(num_para);
-
-        sp(0) = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0))));
-        sp(1) = this->max_zeta / (ET(1) + exp(-p(1)));
-        sp(2) = p(2) * p(2) - .98;
-
-        return sp;
+    DD_MULTIVERSION static void compute_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto g = p[2];
+
+        ET* response = out;
+        ET* dw = out + ld;
+        ET* dz = out + 2 * ld;
+        ET* dg = out + 3 * ld;
+
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto omega_r = x[I] / w;
+            const auto coshlog = (omega_r * omega_r + ET(1)) / (ET(2) * omega_r);
+            const auto sinhlog = (omega_r * omega_r - ET(1)) / (ET(2) * omega_r);
+            const auto factor = coshlog * coshlog + g;
+            const auto inv_factor = ET(1) / (factor * factor);
+
+            dz[I] = (ET(1) + g) * coshlog / factor;
+            response[I] = z * dz[I];
+            dw[I] = z * (ET(1) + g) * (coshlog * coshlog - g) * sinhlog / w * inv_factor;
+            dg[I] = coshlog * (coshlog * coshlog - ET(1)) * z * inv_factor;
+        }
     }
-    [[nodiscard]] Col<ET> ds(const Col<ET>& p) const override {
-        Col<ET> dsp(num_para);
 
-        auto expp = exp(-abs(p(0)));
-        dsp(0) = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0)))) * this->range_omega;
+    using ObjectiveFunction<ET>::s;
+    using ObjectiveFunction<ET>::ds;
 
-        expp = exp(-abs(p(1)));
-        dsp(1) = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
+    void s(const ET* p, ET* sp) const override {
+        sp[0] = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0])));
+        sp[1] = this->max_zeta / (ET(1) + exp(-p[1]));
+        sp[2] = p[2] * p[2] - .98;
+    }
+    void ds(const ET* p, ET* dsp) const override {
+        auto expp = exp(-std::abs(p[0]));
+        dsp[0] = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0]))) * this->range_omega;
 
-        dsp(2) = ET(2) * p(2);
+        expp = exp(-std::abs(p[1]));
+        dsp[1] = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
 
-        return dsp;
+        dsp[2] = ET(2) * p[2];
+    }
+    void inverse_s(const ET* sp, ET* p) const override {
+        p[0] = this->logit((log10(sp[0]) - this->min_omega) / this->range_omega);
+        p[1] = this->logit(sp[1] / this->max_zeta);
+        p[2] = sqrt(std::max(ET(0), sp[2] + ET(.98)));
     }
 
     using ObjectiveFunction<ET>::ObjectiveFunction;
 
     [[nodiscard]] unsigned getSize() const override { return num_para; }
 
-    ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) override {
-        Mat<ET> dg(num_para * this->num_modes, this->sampling.n_cols, fill::none);
-
-        for(auto J = 0u; J < this->num_modes; ++J) {
-            const Col<ET> p(&x(num_para * J), num_para);
-            const auto sp = s(p);
-            const auto dsp = ds(p);
-            dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) {
-                const auto grad = compute_gradient(this->sampling(0, I), sp);
-                this->response(J, I) = grad(0);
-                Col<ET>(&dg(num_para * J, I), num_para, false, true) = grad.tail(num_para) % dsp;
-            });
-        }
-
-        const Row<ET> fi = sum(this->response, 0) - this->sampling.row(1);
-
-        dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) { dg.col(I) *= ET(2) * fi(I); });
-
-        g = sum(dg, 1);
-
-        return accu(pow(fi, ET(2)));
-    }
-
-    [[nodiscard]] QStringList getTypeList(const Mat<ET>& result) const override {
-        QStringList list;
-
-        for(auto I = 0llu; I < result.n_rows; ++I)
-            list.append("Type 3 --- " + QString::number(result(I, 0)) + " " + QString::number(result(I, 1)) + " " + QString::number(result(I, 2)));
-
-        return list;
-    }
+    [[nodiscard]] MT getType() const override { return MT::T3; }
 };
 
 #endif // THREEWISEMEN_H
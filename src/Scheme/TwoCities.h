@@ -19,13 +19,79 @@
 #define TWOCITIES_H
 
 #include "ObjectiveFunction.h"
-#include "parallel_for.hpp"
+#include "simd.hpp"
 
 template<typename ET> class TwoCities : public ObjectiveFunction<ET> {
     static constexpr unsigned num_para = 4;
 
-    static Mat<ET> decimal(const Mat<ET>& n) {
-        return n - arma::round(n);
+    // samples sharing one anchor in the geometric grid kernels
+    static constexpr uword stretch = 32;
+    static constexpr auto ceiling = ET(1E300);
+
+    static ET decimal(const ET n) {
+        return n - std::round(n);
+    }
+
+protected:
+    using Transform = typename ObjectiveFunction<ET>::Transform;
+
+    void kernel_response(const ET* x, const uword n, const ET* p, ET* out) const override {
+        if(this->log_step > ET(0)) compute_response(x[0], this->log_step, n, p, out);
+        else compute_response(x, n, p, out);
+    }
+    void kernel_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) const override {
+        if(this->log_step > ET(0)) compute_gradient(x[0], this->log_step, n, p, out, ld);
+        else compute_gradient(x, n, p, out, ld);
+    }
+
+    // the response is bounded by z(1+r)wr^(2nl+1) below and by z(1+r)/r*wr^-(2nr+1) above the centre
+    void support(const ET* sp, const ET threshold, ET& lower, ET& upper) const override {
+        const auto ra = ET(2) * sp[3] + ET(1);
+        const auto rb = ET(2) * sp[2] + ET(1);
+        const auto r = ra / rb;
+        const auto q = threshold / (sp[1] * (ET(1) + r));
+
+        lower = sp[0] * std::pow(q, ET(1) / ra);
+        upper = sp[0] * std::pow(q * r, -ET(1) / rb);
+    }
+
+    ET penalty(const Transform& t, Mat<ET>& g) const override {
+        ET value{0};
+
+        for(auto J = 0u; J < this->num_modes; ++J)
+            for(auto K = 2u; K < num_para; ++K) {
+                const auto floor_diff = decimal(t.parameter(K, J));
+                if(!g.empty()) g(num_para * J + K) += ET(2) * this->weight * floor_diff * t.derivative(K, J);
+                value += floor_diff * floor_diff;
+            }
+
+        return this->weight * value;
+    }
+
+    [[nodiscard]] uword penalty_size() const override { return (num_para - 2) * this->num_modes; }
+
+    void penalty_residual(const Transform& t, ET* r, Mat<ET>& jacobian, const uword row) const override {
+        const auto factor = std::sqrt(this->weight);
+
+        for(auto J = 0u; J < this->num_modes; ++J)
+            for(auto K = 2u; K < num_para; ++K) {
+                const auto I = (num_para - 2) * J + K - 2;
+                r[I] = factor * decimal(t.parameter(K, J));
+                jacobian(row + I, num_para * J + K) = factor * t.derivative(K, J);
+            }
+    }
+
+    [[nodiscard]] Mat<ET> dictionary_shape() const override {
+        const auto num_order = static_cast<uword>(this->max_order) + 1;
+
+        Mat<ET> shape(2, num_order * num_order);
+        for(auto I = 0llu; I < num_order; ++I)
+            for(auto J = 0llu; J < num_order; ++J) {
+                shape(0, I * num_order + J) = ET(I);
+                shape(1, I * num_order + J) = ET(J);
+            }
+
+        return shape;
     }
 
 public:
@@ -40,118 +106,188 @@ public:
         const auto r = ra / rb;
         const auto xr = x / w;
 
-        return z * (ET(1) + r) * pow(xr, ET(2) * nl + ET(1)) / (ET(1) + r * pow(xr, ET(2) * (ET(1) + nr + nl)));
+        return z * (ET(1) + r) / (pow(xr, -ra) + r * pow(xr, rb));
     }
-    static Col<ET> compute_gradient(const ET x, const Col<ET>& p) {
-        Col<ET> out(num_para + 1);
+    DD_MULTIVERSION static void compute_response(const ET* x, const uword n, const ET* p, ET* out) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto nr = p[2];
+        const auto nl = p[3];
 
-        const auto& w = p(0);
-        const auto& z = p(1);
-        const auto& nr = p(2);
-        const auto& nl = p(3);
-
-        const auto xr = x / w;
-        const auto nps = ET(1) + nr + nl;
         const auto ra = ET(2) * nl + ET(1);
         const auto rb = ET(2) * nr + ET(1);
         const auto r = ra / rb;
 
-        const auto fa = (ET(1) + r) * pow(xr, ET(2) * nl + ET(1));
-        const auto fb = ET(1) + r * pow(xr, ET(2) * nps);
+        // written as z(1+r)/(u+rv) with u=xr^-ra and v=xr^rb as on geometric grids, a quotient of two saturated powers is meaningless
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto logxr = dd::simd::log(x[I] / w);
+            const auto u = std::min(dd::simd::exp(-ra * logxr), ceiling);
+            const auto v = std::min(dd::simd::exp(rb * logxr), ceiling);
+
+            out[I] = z * (ET(1) + r) / (u + r * v);
+        }
+    }
+    DD_MULTIVERSION static void compute_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto nr = p[2];
+        const auto nl = p[3];
 
-        const auto fc = pow(xr, ra);
-        const auto fd = pow(nr + ET(.5), ET(2));
-        const auto fe = pow(xr, ET(2) * nps);
+        const auto ra = ET(2) * nl + ET(1);
+        const auto rb = ET(2) * nr + ET(1);
+        const auto r = ra / rb;
 
-        const auto aw = -ET(2) * fc * ra * nps / (w * rb);
-        const auto anr = -fc * (ET(1) * nl + ET(.5)) / fd;
-        const auto anl = fc * (ET(4) * nps * log(xr) + ET(2)) / rb;
+        ET* response = out;
+        ET* dw = out + ld;
+        ET* dz = out + 2 * ld;
+        ET* dnr = out + 3 * ld;
+        ET* dnl = out + 4 * ld;
+
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto logxr = dd::simd::log(x[I] / w);
+            const auto u = std::min(dd::simd::exp(-ra * logxr), ceiling);
+            const auto v = std::min(dd::simd::exp(rb * logxr), ceiling);
+            const auto d = ET(1) / (u + r * v);
+            const auto su = u * d;
+            const auto sv = v * d;
+
+            dz[I] = (ET(1) + r) * d;
+            response[I] = z * dz[I];
+            dw[I] = response[I] * ra * (sv - su) / w;
+            dnr[I] = -ET(2) * r * response[I] * (ET(1) / (ra + rb) + sv * (logxr - ET(1) / rb));
+            dnl[I] = ET(2) * response[I] * (ET(1) / (ra + rb) + logxr * su - sv / rb);
+        }
+    }
 
-        const auto bw = -ET(2) * fe * ra * nps / (w * rb);
-        const auto bnr = fe * ra * (ET(2) * fd * log(xr) - nr - ET(.5)) / (fd * rb);
-        const auto bnl = ET(2) * fe * (ra * log(xr) + ET(1)) / rb;
+    // on a geometric grid starting at x0 with log(x[I+1]/x[I])=step, the response is written as z(1+r)/(u+rv)
+    // with u=xr^-ra and v=xr^rb, both powers are an anchor per stretch times a table of powers of the grid ratio
+    // u and v are capped so that the quotients below stay finite far away from the centre
+    DD_MULTIVERSION static void compute_response(const ET x0, const ET step, const uword n, const ET* p, ET* out) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto nr = p[2];
+        const auto nl = p[3];
 
-        out(2) = fa / fb;
-        out(0) = z * out(2);
-        out(1) = z / fb * (aw - out(2) * bw);
-        out(3) = z / fb * (anr - out(2) * bnr);
-        out(4) = z / fb * (anl - out(2) * bnl);
+        const auto ra = ET(2) * nl + ET(1);
+        const auto rb = ET(2) * nr + ET(1);
+        const auto r = ra / rb;
+        const auto logx0 = std::log(x0 / w);
+
+        const auto width = std::min(stretch, n);
+        ET tu[stretch], tv[stretch];
+        DD_SIMD_LOOP
+        for(uword K = 0; K < width; ++K) {
+            tu[K] = dd::simd::exp(-ra * step * ET(K));
+            tv[K] = dd::simd::exp(rb * step * ET(K));
+        }
 
-        return out;
+        for(uword A = 0; A < n; A += width) {
+            const auto logxr = logx0 + step * ET(A);
+            const auto cu = dd::simd::exp(-ra * logxr);
+            const auto cv = dd::simd::exp(rb * logxr);
+            const auto m = std::min(width, n - A);
+
+            DD_SIMD_LOOP
+            for(uword K = 0; K < m; ++K) {
+                const auto u = std::min(cu * tu[K], ceiling);
+                const auto v = std::min(cv * tv[K], ceiling);
+                out[A + K] = z * (ET(1) + r) / (u + r * v);
+            }
+        }
     }
+    DD_MULTIVERSION static void compute_gradient(const ET x0, const ET step, const uword n, const ET* p, ET* out, const uword ld) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto nr = p[2];
+        const auto nl = p[3];
 
-    [[nodiscard]] Col<ET> s(const Col<ET>& p) const override {
-        Col<ET> sp(num_para);
-
-        sp(0) = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0))));
-        sp(1) = this->max_zeta / (ET(1) + exp(-p(1)));
-        sp(2) = this->max_order / (ET(1) + exp(-p(2)));
-        sp(3) = this->max_order / (ET(1) + exp(-p(3)));
+        const auto ra = ET(2) * nl + ET(1);
+        const auto rb = ET(2) * nr + ET(1);
+        const auto r = ra / rb;
+        const auto logx0 = std::log(x0 / w);
+
+        ET* response = out;
+        ET* dw = out + ld;
+        ET* dz = out + 2 * ld;
+        ET* dnr = out + 3 * ld;
+        ET* dnl = out + 4 * ld;
+
+        const auto width = std::min(stretch, n);
+        ET tu[stretch], tv[stretch];
+        DD_SIMD_LOOP
+        for(uword K = 0; K < width; ++K) {
+            tu[K] = dd::simd::exp(-ra * step * ET(K));
+            tv[K] = dd::simd::exp(rb * step * ET(K));
+        }
 
-        return sp;
+        for(uword A = 0; A < n; A += width) {
+            const auto logxa = logx0 + step * ET(A);
+            const auto cu = dd::simd::exp(-ra * logxa);
+            const auto cv = dd::simd::exp(rb * logxa);
+            const auto m = std::min(width, n - A);
+
+            DD_SIMD_LOOP
+            for(uword K = 0; K < m; ++K) {
+                const auto I = A + K;
+                const auto logxr = logxa + step * ET(K);
+                const auto u = std::min(cu * tu[K], ceiling);
+                const auto v = std::min(cv * tv[K], ceiling);
+                const auto d = ET(1) / (u + r * v);
+                const auto su = u * d;
+                const auto sv = v * d;
+
+                dz[I] = (ET(1) + r) * d;
+                response[I] = z * dz[I];
+                dw[I] = response[I] * ra * (sv - su) / w;
+                dnr[I] = -ET(2) * r * response[I] * (ET(1) / (ra + rb) + sv * (logxr - ET(1) / rb));
+                dnl[I] = ET(2) * response[I] * (ET(1) / (ra + rb) + logxr * su - sv / rb);
+            }
+        }
     }
-    [[nodiscard]] Col<ET> ds(const Col<ET>& p) const override {
-        Col<ET> dsp(num_para);
 
-        auto expp = exp(-abs(p(0)));
-        dsp(0) = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0)))) * this->range_omega;
+    using ObjectiveFunction<ET>::s;
+    using ObjectiveFunction<ET>::ds;
 
-        expp = exp(-abs(p(1)));
-        dsp(1) = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
+    void s(const ET* p, ET* sp) const override {
+        sp[0] = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0])));
+        sp[1] = this->max_zeta / (ET(1) + exp(-p[1]));
+        sp[2] = this->max_order / (ET(1) + exp(-p[2]));
+        sp[3] = this->max_order / (ET(1) + exp(-p[3]));
+    }
+    void ds(const ET* p, ET* dsp) const override {
+        auto expp = exp(-std::abs(p[0]));
+        dsp[0] = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0]))) * this->range_omega;
 
-        expp = exp(-abs(p(2)));
-        dsp(2) = this->max_order * expp * pow(ET(1) + expp, -ET(2));
+        expp = exp(-std::abs(p[1]));
+        dsp[1] = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
 
-        expp = exp(-abs(p(3)));
-        dsp(3) = this->max_order * expp * pow(ET(1) + expp, -ET(2));
+        expp = exp(-std::abs(p[2]));
+        dsp[2] = this->max_order * expp * pow(ET(1) + expp, -ET(2));
 
-        return dsp;
+        expp = exp(-std::abs(p[3]));
+        dsp[3] = this->max_order * expp * pow(ET(1) + expp, -ET(2));
+    }
+    void inverse_s(const ET* sp, ET* p) const override {
+        p[0] = this->logit((log10(sp[0]) - this->min_omega) / this->range_omega);
+        p[1] = this->logit(sp[1] / this->max_zeta);
+        p[2] = this->logit(sp[2] / this->max_order);
+        p[3] = this->logit(sp[3] / this->max_order);
     }
 
     using ObjectiveFunction<ET>::ObjectiveFunction;
 
     [[nodiscard]] unsigned getSize() const override { return num_para; }
 
-    ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) override {
-        Mat<ET> dg(num_para * this->num_modes, this->sampling.n_cols, fill::none);
-        Mat<ET> n(2, this->num_modes, fill::none);
-        Mat<ET> dn(2, this->num_modes, fill::none);
-
-        for(auto J = 0u; J < this->num_modes; ++J) {
-            const Col<ET> p(&x(num_para * J), num_para);
-            const auto sp = s(p);
-            const auto dsp = ds(p);
-            n.col(J) = sp.tail(2);
-            dn.col(J) = dsp.tail(2);
-            dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) {
-                const auto grad = compute_gradient(this->sampling(0, I), sp);
-                this->response(J, I) = grad(0);
-                Col<ET>(&dg(num_para * J, I), num_para, false, true) = grad.tail(num_para) % dsp;
-            });
-        }
-
-        const Row<ET> fi = sum(this->response, 0) - this->sampling.row(1);
-
-        dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) { dg.col(I) *= ET(2) * fi(I); });
-
-        g = sum(dg, 1);
-
-        const Mat<ET> floor_diff = decimal(n).t();
-
-        g(num_para * this->base + 2) += ET(2) * this->weight * floor_diff.col(0) % dn.row(0).t();
-        g(num_para * this->base + 3) += ET(2) * this->weight * floor_diff.col(1) % dn.row(1).t();
-
-        return accu(pow(fi, ET(2))) + this->weight * accu(pow(floor_diff, ET(2)));
-    }
-
     [[nodiscard]] size_t NumConstraints() const override { return 2 * this->num_modes; }
 
     ET EvaluateConstraint(const size_t i, const Mat<ET>& x) override {
         const Col<ET> p(&x(num_para * (i / 2)), num_para);
 
-        const Col<ET> floor_diff = decimal(Mat<ET>{s(p)(i % 2 + 2)});
+        const auto floor_diff = decimal(s(p)(i % 2 + 2));
 
-        return this->weight * floor_diff(0) * floor_diff(0);
+        return this->weight * floor_diff * floor_diff;
     }
     void GradientConstraint(const size_t i, const Mat<ET>& x, Mat<ET>& g) override {
         const auto i_mode = i / 2;
@@ -159,20 +295,13 @@ public:
 
         const Col<ET> p(&x(num_para * i_mode), num_para);
 
-        const Col<ET> floor_diff = decimal(Mat<ET>{s(p)(i_shift)});
+        const auto floor_diff = decimal(s(p)(i_shift));
 
         g = zeros<Mat<ET>>(size(x));
-        g(num_para * i_mode + i_shift) = ET(2) * this->weight * floor_diff(0) * ds(p)(i_shift);
+        g(num_para * i_mode + i_shift) = ET(2) * this->weight * floor_diff * ds(p)(i_shift);
     }
 
-    [[nodiscard]] QStringList getTypeList(const Mat<ET>& result) const override {
-        QStringList list;
-
-        for(auto I = 0llu; I < result.n_rows; ++I)
-            list.append("Type 2 --- " + QString::number(result(I, 0)) + " " + QString::number(result(I, 1)) + " " + QString::number(result(I, 2)) + " " + QString::number(result(I, 3)));
-
-        return list;
-    }
+    [[nodiscard]] MT getType() const override { return MT::T2; }
 };
 
 #endif // TWOCITIES_H
@@ -19,131 +19,157 @@
 #define UNICORN_H
 
 #include "ObjectiveFunction.h"
-#include "parallel_for.hpp"
+#include "simd.hpp"
 
 template<typename ET> class Unicorn : public ObjectiveFunction<ET> {
     static constexpr unsigned num_para = 3;
 
-    static Mat<ET> decimal(const Mat<ET>& n) {
-        return n - arma::round(n);
+    static ET decimal(const ET n) {
+        return n - std::round(n);
     }
 
-public:
-    static ET compute_response(const ET x, const Col<ET>& p) {
-        const auto& w = p(0);
-        const auto& z = p(1);
-        const auto& n = p(2);
+protected:
+    using Transform = typename ObjectiveFunction<ET>::Transform;
 
-        const auto omega_r = x / w;
-        const auto logw = log(omega_r);
-        const auto coshlog = cosh(logw);
+    void kernel_response(const ET* x, const uword n, const ET* p, ET* out) const override { compute_response(x, n, p, out); }
+    void kernel_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) const override { compute_gradient(x, n, p, out, ld); }
 
-        return z * pow(coshlog, -ET(2) * n - ET(1));
-    }
-    static Col<ET> compute_gradient(const ET x, const Col<ET>& p) {
-        Col<ET> out(num_para + 1);
+    // cosh(log(wr))=c has the roots c-+sqrt(c^2-1)
+    void support(const ET* sp, const ET threshold, ET& lower, ET& upper) const override {
+        const auto q = threshold / sp[1];
+        if(q >= ET(1)) {
+            lower = std::numeric_limits<ET>::infinity();
+            upper = ET(0);
+            return;
+        }
 
-        const auto& w = p(0);
-        const auto& z = p(1);
-        const auto& n = p(2);
+        const auto c = std::pow(q, -ET(1) / (ET(2) * sp[2] + ET(1)));
+        const auto root = std::sqrt(c * c - ET(1));
+        lower = sp[0] * (c - root);
+        upper = sp[0] * (c + root);
+    }
 
-        const auto omega_r = x / w;
-        const auto logw = log(omega_r);
-        const auto coshlog = cosh(logw);
+    ET penalty(const Transform& t, Mat<ET>& g) const override {
+        ET value{0};
 
-        out(2) = pow(coshlog, -ET(2) * n - ET(1));
-        out(0) = z * out(2);
-        out(1) = (ET(2) * n + ET(1)) * out(0) / coshlog * sinh(logw) / w;
-        out(3) = -ET(2) * out(2) * z * log(coshlog);
+        for(auto J = 0u; J < this->num_modes; ++J) {
+            const auto floor_diff = decimal(t.parameter(2, J));
+            if(!g.empty()) g(num_para * J + 2) += ET(2) * this->weight * floor_diff * t.derivative(2, J);
+            value += floor_diff * floor_diff;
+        }
 
-        return out;
+        return this->weight * value;
     }
 
-    [[nodiscard]] Col<ET> s(const Col<ET>& p) const override {
-        Col<ET> sp(num_para);
+    [[nodiscard]] uword penalty_size() const override { return this->num_modes; }
 
-        sp(0) = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0))));
-        sp(1) = this->max_zeta / (ET(1) + exp(-p(1)));
-        sp(2) = this->max_order / (ET(1) + exp(-p(2)));
+    void penalty_residual(const Transform& t, ET* r, Mat<ET>& jacobian, const uword row) const override {
+        const auto factor = std::sqrt(this->weight);
 
-        return sp;
+        for(auto J = 0u; J < this->num_modes; ++J) {
+            r[J] = factor * decimal(t.parameter(2, J));
+            jacobian(row + J, num_para * J + 2) = factor * t.derivative(2, J);
+        }
     }
-    [[nodiscard]] Col<ET> ds(const Col<ET>& p) const override {
-        Col<ET> dsp(num_para);
 
-        auto expp = exp(-abs(p(0)));
-        dsp(0) = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0)))) * this->range_omega;
+    [[nodiscard]] Mat<ET> dictionary_shape() const override { return regspace<Row<ET>>(0, this->max_order); }
 
-        expp = exp(-abs(p(1)));
-        dsp(1) = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
+public:
+    static ET compute_response(const ET x, const Col<ET>& p) {
+        const auto& w = p(0);
+        const auto& z = p(1);
+        const auto& n = p(2);
 
-        expp = exp(-abs(p(2)));
-        dsp(2) = this->max_order * expp * pow(ET(1) + expp, -ET(2));
+        const auto omega_r = x / w;
+        const auto logw = log(omega_r);
+        const auto coshlog = cosh(logw);
 
-        return dsp;
+        return z * pow(coshlog, -ET(2) * n - ET(1));
     }
+    DD_MULTIVERSION static void compute_response(const ET* x, const uword n, const ET* p, ET* out) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto np = p[2];
 
-    using ObjectiveFunction<ET>::ObjectiveFunction;
-
-    [[nodiscard]] unsigned getSize() const override { return num_para; }
-
-    ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) override {
-        Mat<ET> dg(num_para * this->num_modes, this->sampling.n_cols, fill::none);
-        Col<ET> n(this->num_modes, fill::none);
-        Col<ET> dn(this->num_modes, fill::none);
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto omega_r = x[I] / w;
+            const auto coshlog = (omega_r * omega_r + ET(1)) / (ET(2) * omega_r);
 
-        for(auto J = 0u; J < this->num_modes; ++J) {
-            const Col<ET> p(&x(num_para * J), num_para);
-            const auto sp = s(p);
-            const auto dsp = ds(p);
-            n(J) = sp(2);
-            dn(J) = dsp(2);
-            dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) {
-                const auto grad = compute_gradient(this->sampling(0, I), sp);
-                this->response(J, I) = grad(0);
-                Col<ET>(&dg(num_para * J, I), num_para, false, true) = grad.tail(num_para) % dsp;
-            });
+            out[I] = z * dd::simd::exp((-ET(2) * np - ET(1)) * dd::simd::log(coshlog));
         }
+    }
+    DD_MULTIVERSION static void compute_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) {
+        const auto w = p[0];
+        const auto z = p[1];
+        const auto np = p[2];
+
+        ET* response = out;
+        ET* dw = out + ld;
+        ET* dz = out + 2 * ld;
+        ET* dn = out + 3 * ld;
+
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto omega_r = x[I] / w;
+            const auto square = omega_r * omega_r;
+            const auto coshlog = (square + ET(1)) / (ET(2) * omega_r);
+            const auto logcosh = dd::simd::log(coshlog);
+
+            dz[I] = dd::simd::exp((-ET(2) * np - ET(1)) * logcosh);
+            response[I] = z * dz[I];
+            dw[I] = (ET(2) * np + ET(1)) * response[I] * (square - ET(1)) / (square + ET(1)) / w;
+            dn[I] = -ET(2) * dz[I] * z * logcosh;
+        }
+    }
 
-        const Row<ET> fi = sum(this->response, 0) - this->sampling.row(1);
+    using ObjectiveFunction<ET>::s;
+    using ObjectiveFunction<ET>::ds;
 
-        dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) { dg.col(I) *= ET(2) * fi(I); });
+    void s(const ET* p, ET* sp) const override {
+        sp[0] = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0])));
+        sp[1] = this->max_zeta / (ET(1) + exp(-p[1]));
+        sp[2] = this->max_order / (ET(1) + exp(-p[2]));
+    }
+    void ds(const ET* p, ET* dsp) const override {
+        auto expp = exp(-std::abs(p[0]));
+        dsp[0] = log(ET(10)) * expp * pow(ET(1) + expp, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0]))) * this->range_omega;
 
-        g = sum(dg, 1);
+        expp = exp(-std::abs(p[1]));
+        dsp[1] = this->max_zeta * expp * pow(ET(1) + expp, -ET(2));
 
-        const Col<ET> floor_diff = decimal(n);
+        expp = exp(-std::abs(p[2]));
+        dsp[2] = this->max_order * expp * pow(ET(1) + expp, -ET(2));
+    }
+    void inverse_s(const ET* sp, ET* p) const override {
+        p[0] = this->logit((log10(sp[0]) - this->min_omega) / this->range_omega);
+        p[1] = this->logit(sp[1] / this->max_zeta);
+        p[2] = this->logit(sp[2] / this->max_order);
+    }
 
-        g(num_para * this->base + 2) += ET(2) * this->weight * floor_diff % dn;
+    using ObjectiveFunction<ET>::ObjectiveFunction;
 
-        return accu(pow(fi, ET(2))) + this->weight * accu(pow(floor_diff, ET(2)));
-    }
+    [[nodiscard]] unsigned getSize() const override { return num_para; }
 
     [[nodiscard]] size_t NumConstraints() const override { return this->num_modes; }
 
     ET EvaluateConstraint(const size_t i, const Mat<ET>& x) override {
         const Col<ET> p(&x(num_para * i), num_para);
 
-        const Col<ET> floor_diff = decimal(Mat<ET>{s(p)(2)});
+        const auto floor_diff = decimal(s(p)(2));
 
-        return this->weight * floor_diff(0) * floor_diff(0);
+        return this->weight * floor_diff * floor_diff;
     }
     void GradientConstraint(const size_t i, const Mat<ET>& x, Mat<ET>& g) override {
         const Col<ET> p(&x(num_para * i), num_para);
 
-        const Col<ET> floor_diff = decimal(Mat<ET>{s(p)(2)});
+        const auto floor_diff = decimal(s(p)(2));
 
         g = zeros<Mat<ET>>(size(x));
-        g(num_para * i + 2) = ET(2) * this->weight * floor_diff(0) * ds(p)(2);
+        g(num_para * i + 2) = ET(2) * this->weight * floor_diff * ds(p)(2);
     }
 
-    [[nodiscard]] QStringList getTypeList(const Mat<ET>& result) const override {
-        QStringList list;
-
-        for(auto I = 0llu; I < result.n_rows; ++I)
-            list.append("Type 1 --- " + QString::number(result(I, 0)) + " " + QString::number(result(I, 1)) + " " + QString::number(result(I, 2)));
-
-        return list;
-    }
+    [[nodiscard]] MT getType() const override { return MT::T1; }
 };
 
 #endif // UNICORN_H
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef VARIABLEPROJECTION_HPP
+#define VARIABLEPROJECTION_HPP
+
+#include "BoundedLeastSquares.hpp"
+#include "ObjectiveFunction.h"
+
+// exposes all parameters but the amplitude to the optimizer
+// the response is linear in the amplitude so that the optimal amplitudes for the current
+// frequencies and orders follow from a bounded linear least squares problem
+// the gradient of the projected objective is the partial gradient at the optimal amplitudes
+template<typename ET> class VariableProjection {
+    // all schemes store the amplitude as the second parameter
+    static constexpr unsigned amplitude = 1;
+
+    const ObjectiveFunction<ET>& f;
+
+    const unsigned num_para, num_modes;
+
+    // full parameters with zero amplitudes
+    [[nodiscard]] Mat<ET> expand(const Mat<ET>& x) const {
+        Mat<ET> full(num_para * num_modes, 1, fill::zeros);
+        for(auto J = 0u; J < num_modes; ++J)
+            for(auto K = 0u; K < num_para - 1; ++K) full(num_para * J + K + (K >= amplitude)) = x((num_para - 1) * J + K);
+        return full;
+    }
+
+    [[nodiscard]] typename ObjectiveFunction<ET>::Transform project(const Mat<ET>& x) const {
+        auto t = f.transform(expand(x));
+        t.parameter.row(amplitude).ones();
+        t.derivative.row(amplitude).zeros();
+
+        constexpr auto block_size = ObjectiveFunction<ET>::block_size;
+
+        // normal equations of unit amplitude responses, the last column holds the projection of the target
+        const Mat<ET> normal = dd::parallel_reduce(
+            0llu, f.num_blocks, Mat<ET>(num_modes, num_modes + 1, fill::zeros), [&](const uword B, Mat<ET>& sum) {
+                const auto offset = B * block_size;
+
+                auto& block = ObjectiveFunction<ET>::workspace();
+                block.set_size(block_size, num_modes + 1);
+
+                for(auto J = 0u; J < num_modes; ++J) f.kernel_response(f.frequency.memptr() + offset, block_size, t.parameter.colptr(J), block.colptr(J));
+                block.col(num_modes) = f.target.subvec(offset, arma::size(block_size, 1));
+                if(offset + block_size > f.num_samples) block.tail_rows(offset + block_size - f.num_samples).zeros();
+
+                sum += block.head_cols(num_modes).t() * block;
+            },
+            [](const Mat<ET>& a, const Mat<ET>& b) -> Mat<ET> { return a + b; });
+
+        t.parameter.row(amplitude) = dd::bounded_least_squares<ET>(normal.head_cols(num_modes), normal.col(num_modes), ET(0), f.max_zeta).t();
+
+        // the support depends on the amplitude
+        f.localize(t);
+
+        return t;
+    }
+
+    [[nodiscard]] uvec amplitude_index() const { return regspace<uvec>(amplitude, num_para, num_para * num_modes - 1); }
+
+public:
+    explicit VariableProjection(const ObjectiveFunction<ET>& F)
+        : f(F)
+        , num_para(F.getSize())
+        , num_modes(F.getNumberModes()) {}
+
+    [[nodiscard]] unsigned getSize() const { return num_para - 1; }
+    [[nodiscard]] unsigned getNumberModes() const { return num_modes; }
+
+    [[nodiscard]] size_t NumConstraints() const { return 0; }
+
+    ET Evaluate(const Mat<ET>& x) {
+        return f.evaluate_value(project(x));
+    }
+    void Gradient(const Mat<ET>& x, Mat<ET>& g) { EvaluateWithGradient(x, g); }
+
+    // every candidate needs its own linear solve, candidates are scored concurrently
+    void EvaluateBatch(const Mat<ET>& candidates, Col<ET>& objective) const {
+        objective.set_size(candidates.n_cols);
+        dd::parallel_for(0llu, candidates.n_cols, [&](const uword I) { objective(I) = f.evaluate_value(project(candidates.col(I))); });
+    }
+
+    ET EvaluateConstraint(const size_t, const Mat<ET>&) { return ET(0); }
+    void GradientConstraint(const size_t, const Mat<ET>& x, Mat<ET>& g) { g.zeros(size(x)); }
+
+    ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) {
+        const auto value = f.evaluate_gradient(project(x), g);
+        g.shed_rows(amplitude_index());
+
+        return value;
+    }
+
+    // Kaufman's approximation, the partial Jacobian at the optimal amplitudes is projected onto the orthogonal
+    // complement of the unit responses of the modes whose amplitudes are not at a bound, J^T*r is unchanged
+    ET EvaluateWithJacobian(const Mat<ET>& x, Col<ET>& r, Mat<ET>& jacobian) {
+        const auto t = project(x);
+        const auto value = f.evaluate_jacobian(t, r, jacobian);
+        jacobian.shed_cols(amplitude_index());
+
+        const uvec free = find(t.parameter.row(amplitude) > ET(0) && t.parameter.row(amplitude) < f.max_zeta);
+        if(free.empty()) return value;
+
+        Mat<ET> unit = t.parameter.cols(free);
+        unit.row(amplitude).ones();
+
+        Mat<ET> basis(f.num_samples, free.n_elem);
+        dd::parallel_for(0llu, free.n_elem, [&](const uword J) { f.kernel_response(f.frequency.memptr(), f.num_samples, unit.colptr(J), basis.colptr(J)); });
+
+        Mat<ET> q, upper;
+        qr_econ(q, upper, basis);
+        jacobian.head_rows(f.num_samples) -= q * (q.t() * jacobian.head_rows(f.num_samples));
+
+        return value;
+    }
+    // the projection would fill in the sparse Jacobian, so it keeps the partial derivatives at the optimal amplitudes
+    // J^T*r is still exact but J^T*J misses the coupling through the amplitudes, which costs LM extra iterations
+    ET EvaluateWithJacobian(const Mat<ET>& x, Col<ET>& r, SpMat<ET>& jacobian) { return f.evaluate_jacobian(project(x), r, jacobian, amplitude); }
+
+    // the support grows with the amplitude, the supports at the upper bound cover those at the optimal amplitudes
+    // so the decision needs no linear solve and only picks the sparse form when it is sparse for any amplitude
+    [[nodiscard]] bool SparseJacobian(const Mat<ET>& x) const {
+        auto t = f.transform(expand(x));
+        t.parameter.row(amplitude).fill(f.max_zeta);
+        f.localize(t);
+        return f.sparse(t);
+    }
+
+    // mapped parameters of all modes with the optimal amplitudes, one mode per column
+    [[nodiscard]] Mat<ET> parameter(const Mat<ET>& x) const { return project(x).parameter; }
+};
+
+#endif // VARIABLEPROJECTION_HPP
@@ -19,11 +19,29 @@
 #define ZERODAY_H
 
 #include "ObjectiveFunction.h"
-#include "parallel_for.hpp"
+#include "simd.hpp"
 
 template<typename ET> class ZeroDay : public ObjectiveFunction<ET> {
     static constexpr unsigned num_para = 2;
 
+protected:
+    void kernel_response(const ET* x, const uword n, const ET* p, ET* out) const override { compute_response(x, n, p, out); }
+    void kernel_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) const override { compute_gradient(x, n, p, out, ld); }
+
+    // 2wr/(1+wr^2)=q has the roots (1-+sqrt(1-q^2))/q
+    void support(const ET* sp, const ET threshold, ET& lower, ET& upper) const override {
+        const auto q = threshold / sp[1];
+        if(q >= ET(1)) {
+            lower = std::numeric_limits<ET>::infinity();
+            upper = ET(0);
+            return;
+        }
+
+        const auto root = std::sqrt(ET(1) - q * q);
+        lower = sp[0] * (ET(1) - root) / q;
+        upper = sp[0] * (ET(1) + root) / q;
+    }
+
 public:
     static ET compute_response(const ET x, const Col<ET>& p) {
         const auto& w = p(0);
@@ -33,77 +51,60 @@ public:
 
         return z * ET(2) * wr / (ET(1) + wr * wr);
     }
-    static Col<ET> compute_gradient(const ET x, const Col<ET>& p) {
-        Col<ET> out(num_para + 1);
+    DD_MULTIVERSION static void compute_response(const ET* x, const uword n, const ET* p, ET* out) {
+        const auto w = p[0];
+        const auto z = p[1];
 
-        const auto& w = p(0);
-        const auto& z = p(1);
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto wr = x[I] / w;
 
-        const auto wr = x / w;
-        const auto factor = wr * wr + ET(1);
-
-        out(2) = ET(2) * wr / factor;
-        out(0) = out(2) * z;
-        out(1) = out(0) / w * (wr * wr - ET(1)) / factor;
-
-        return out;
+            out[I] = z * ET(2) * wr / (ET(1) + wr * wr);
+        }
     }
-
-    [[nodiscard]] Col<ET> s(const Col<ET>& p) const override {
-        Col<ET> sp(num_para);
-
-        sp(0) = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0))));
-        sp(1) = this->max_zeta / (ET(1) + exp(-p(1)));
-
-        return sp;
+    DD_MULTIVERSION static void compute_gradient(const ET* x, const uword n, const ET* p, ET* out, const uword ld) {
+        const auto w = p[0];
+        const auto z = p[1];
+
+        ET* response = out;
+        ET* dw = out + ld;
+        ET* dz = out + 2 * ld;
+
+        DD_SIMD_LOOP
+        for(uword I = 0; I < n; ++I) {
+            const auto wr = x[I] / w;
+            const auto factor = wr * wr + ET(1);
+
+            dz[I] = ET(2) * wr / factor;
+            response[I] = dz[I] * z;
+            dw[I] = response[I] / w * (wr * wr - ET(1)) / factor;
+        }
     }
-    [[nodiscard]] Col<ET> ds(const Col<ET>& p) const override {
-        const auto expw = exp(-abs(p(0)));
-        const auto expz = exp(-abs(p(1)));
 
-        Col<ET> dsp(num_para);
+    using ObjectiveFunction<ET>::s;
+    using ObjectiveFunction<ET>::ds;
 
-        dsp(0) = log(ET(10)) * expw * pow(ET(1) + expw, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p(0)))) * this->range_omega;
-        dsp(1) = this->max_zeta * expz * pow(ET(1) + expz, -ET(2));
+    void s(const ET* p, ET* sp) const override {
+        sp[0] = pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0])));
+        sp[1] = this->max_zeta / (ET(1) + exp(-p[1]));
+    }
+    void ds(const ET* p, ET* dsp) const override {
+        const auto expw = exp(-std::abs(p[0]));
+        const auto expz = exp(-std::abs(p[1]));
 
-        return dsp;
+        dsp[0] = log(ET(10)) * expw * pow(ET(1) + expw, -ET(2)) * pow(ET(10), this->min_omega + this->range_omega / (ET(1) + exp(-p[0]))) * this->range_omega;
+        dsp[1] = this->max_zeta * expz * pow(ET(1) + expz, -ET(2));
+    }
+    void inverse_s(const ET* sp, ET* p) const override {
+        p[0] = this->logit((log10(sp[0]) - this->min_omega) / this->range_omega);
+        p[1] = this->logit(sp[1] / this->max_zeta);
     }
 
     using ObjectiveFunction<ET>::ObjectiveFunction;
 
     [[nodiscard]] unsigned getSize() const override { return num_para; }
 
-    ET EvaluateWithGradient(const Mat<ET>& x, Mat<ET>& g) override {
-        Mat<ET> dg(num_para * this->num_modes, this->sampling.n_cols, fill::none);
-
-        for(auto J = 0u; J < this->num_modes; ++J) {
-            const Col<ET> p(&x(num_para * J), num_para);
-            const auto sp = s(p);
-            const auto dsp = ds(p);
-            dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) {
-                const auto grad = compute_gradient(this->sampling(0, I), sp);
-                this->response(J, I) = grad(0);
-                Col<ET>(&dg(num_para * J, I), num_para, false, true) = grad.tail(num_para) % dsp;
-            });
-        }
-
-        const Row<ET> fi = sum(this->response, 0) - this->sampling.row(1);
-
-        dd::parallel_for(0llu, this->sampling.n_cols, [&](const uword I) { dg.col(I) *= ET(2) * fi(I); });
-
-        g = sum(dg, 1);
-
-        return accu(pow(fi, ET(2)));
-    }
-
-    [[nodiscard]] QStringList getTypeList(const Mat<ET>& result) const override {
-        QStringList list;
-
-        for(auto I = 0llu; I < result.n_rows; ++I)
-            list.append("Type 0 --- " + QString::number(result(I, 0)) + " " + QString::number(result(I, 1)));
-
-        return list;
-    }
+    [[nodiscard]] MT getType() const override { return MT::T0; }
 };
 
 #endif // ZERODAY_H
@@ -22,18 +22,53 @@
 #ifdef emit
 #undef emit
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 #define emit
 #else
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 #endif
+#elif defined(_OPENMP)
+#include <cstddef>
+#include <exception>
 #endif
 
 namespace dd {
     template<typename index, typename lmd> void parallel_for(index begin, index end, lmd&& lambda) {
 #ifdef DD_TBB_ENABLED
         tbb::parallel_for(begin, end, std::forward<lmd>(lambda));
+#elif defined(_OPENMP)
+        // exceptions must not leave the parallel region, keep the first one and rethrow afterwards
+        std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+        for(std::ptrdiff_t I = 0; I < static_cast<std::ptrdiff_t>(end - begin); ++I) {
+            try {
+                lambda(static_cast<index>(begin + I));
+            }
+            catch(...) {
+#pragma omp critical(dd_parallel_for)
+                if(!error) error = std::current_exception();
+            }
+        }
+        if(error) std::rethrow_exception(error);
 #else
         for(index I = begin; I < end; ++I) lambda(I);
+#endif
+    }
+
+    // the splitting does not depend on scheduling so that the result is reproducible
+    template<typename index, typename T, typename lmd, typename rdc> T parallel_reduce(index begin, index end, const T& identity, lmd&& lambda, [[maybe_unused]] rdc&& reduction) {
+#ifdef DD_TBB_ENABLED
+        return tbb::parallel_deterministic_reduce(
+            tbb::blocked_range<index>(begin, end, 1), identity, [&](const tbb::blocked_range<index>& range, T value) {
+                for(auto I = range.begin(); I != range.end(); ++I) lambda(I, value);
+                return value;
+            },
+            std::forward<rdc>(reduction));
+#else
+        T value = identity;
+        for(index I = begin; I < end; ++I) lambda(I, value);
+        return value;
 #endif
     }
 } // namespace dd
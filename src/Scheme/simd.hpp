@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * Copyright (C) 2022-2026 Theodore Chang
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DAMPING_DOLPHIN_SIMD_HPP
+#define DAMPING_DOLPHIN_SIMD_HPP
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Kernels marked with DD_MULTIVERSION are compiled once per ISA level and the
+// best clone is picked by the loader, so a single binary runs on any x86-64.
+#if defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define DD_MULTIVERSION __attribute__((target_clones("default", "avx2", "avx512f")))
+#endif
+#endif
+#ifndef DD_MULTIVERSION
+#define DD_MULTIVERSION
+#endif
+
+#ifdef __GNUC__
+#define DD_INLINE inline __attribute__((always_inline))
+#else
+#define DD_INLINE inline
+#endif
+
+#ifdef _OPENMP
+#define DD_SIMD_LOOP _Pragma("omp simd")
+#else
+#define DD_SIMD_LOOP
+#endif
+
+namespace dd::simd {
+    // Branch-free exp/log that the compiler can vectorize inside DD_SIMD_LOOP.
+    // Arguments are assumed to be finite, log further requires positive normal inputs.
+    // exp/log are accurate to about one ulp, types other than double use the standard library.
+
+    template<typename T> DD_INLINE T exp(const T x) {
+        if constexpr(!std::is_same_v<T, double>) return std::exp(x);
+        else {
+            constexpr auto shift = 0x1.8p52;
+            constexpr auto inv_ln2 = 0x1.71547652b82fep0;
+            constexpr auto ln2_hi = 0x1.62e42fefa3800p-1;
+            constexpr auto ln2_lo = 0x1.ef35793c76730p-45;
+
+            // saturate |x| via its bit pattern, floating point comparisons would block if-conversion
+            constexpr auto limit = std::bit_cast<std::uint64_t>(708.25);
+            const auto bits = std::bit_cast<std::uint64_t>(x);
+            const auto magnitude = bits & 0x7FFFFFFFFFFFFFFFu;
+            const auto y = std::bit_cast<double>((magnitude < limit ? magnitude : limit) | (bits & 0x8000000000000000u));
+
+            auto kd = y * inv_ln2 + shift;
+            const auto ki = std::bit_cast<std::uint64_t>(kd);
+            kd -= shift;
+
+            const auto r = y - kd * ln2_hi - kd * ln2_lo;
+
+            auto p = 1. / 479001600.;
+            p = p * r + 1. / 39916800.;
+            p = p * r + 1. / 3628800.;
+            p = p * r + 1. / 362880.;
+            p = p * r + 1. / 40320.;
+            p = p * r + 1. / 5040.;
+            p = p * r + 1. / 720.;
+            p = p * r + 1. / 120.;
+            p = p * r + 1. / 24.;
+            p = p * r + 1. / 6.;
+            p = p * r + .5;
+            p = p * r + 1.;
+            p = p * r + 1.;
+
+            return p * std::bit_cast<double>((ki + 1023u) << 52);
+        }
+    }
+
+    template<typename T> DD_INLINE T log(const T x) {
+        if constexpr(!std::is_same_v<T, double>) return std::log(x);
+        else {
+            constexpr auto ln2_hi = 0x1.62e42fefa3800p-1;
+            constexpr auto ln2_lo = 0x1.ef35793c76730p-45;
+            constexpr auto two52 = 0x1p52;
+
+            // shift the exponent so that the mantissa falls in [sqrt(.5), sqrt(2)) using integer arithmetic only
+            const auto bits = std::bit_cast<std::uint64_t>(x);
+            const auto k = (bits - 0x3FE6A09E667F3BCDu + (1024ull << 52)) >> 52;
+
+            const auto e = std::bit_cast<double>(k | std::bit_cast<std::uint64_t>(two52)) - (two52 + 1024.);
+            const auto m = std::bit_cast<double>(bits - (k << 52) + (1024ull << 52));
+
+            const auto f = (m - 1.) / (m + 1.);
+            const auto s = f * f;
+
+            auto p = 1. / 23.;
+            p = p * s + 1. / 21.;
+            p = p * s + 1. / 19.;
+            p = p * s + 1. / 17.;
+            p = p * s + 1. / 15.;
+            p = p * s + 1. / 13.;
+            p = p * s + 1. / 11.;
+            p = p * s + 1. / 9.;
+            p = p * s + 1. / 7.;
+            p = p * s + 1. / 5.;
+            p = p * s + 1. / 3.;
+
+            return e * ln2_hi + (2. * f + (2. * f * s * p + e * ln2_lo));
+        }
+    }
+} // namespace dd::simd
+
+#endif // DAMPING_DOLPHIN_SIMD_HPP
@@ -18,12 +18,10 @@
 #ifndef DAMPINGDOLPHIN_H
 #define DAMPINGDOLPHIN_H
 
-#include <QString>
-#include <QStringList>
-#include <QVector>
 #include <algorithm>
 #include <armadillo>
 #include <cmath>
+#include <concepts>
 #include <ensmallen.hpp>
 #include <iostream>
 #include <memory>
@@ -38,4 +36,17 @@ enum class MT { T0,
                 T3,
                 T4 };
 
+namespace dd {
+    // ens::Callback::BeginOptimization() drops the result, a callback returning true here stops the optimization before the first step
+    template<typename OptimizerType, typename FunctionType, typename MatType, typename... CallbackTypes> bool begin_optimization(OptimizerType& optimizer, FunctionType& function, MatType& x, CallbackTypes&... callbacks) {
+        bool terminate = false;
+        [[maybe_unused]] const auto begin = [&]<typename CallbackType>(CallbackType& callback) {
+            if constexpr(requires { { callback.BeginOptimization(optimizer, function, x) } -> std::convertible_to<bool>; }) terminate |= static_cast<bool>(callback.BeginOptimization(optimizer, function, x));
+            else Callback::BeginOptimization(optimizer, function, x, callback);
+        };
+        (begin(callbacks), ...);
+        return terminate;
+    }
+} // namespace dd
+
 #endif // DAMPINGDOLPHIN_H